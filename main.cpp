@@ -1,13 +1,74 @@
 #include <SFML/Graphics.hpp>
+#include <SFML/Audio.hpp>
 #include <string>
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <bitset>
+#include <algorithm>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
+#include <stdarg.h>
+#include <new>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
 using namespace std;
 
 const float pi = 3.1415927f;
 
+// Number of heap allocations made by the calling thread. Every allocation of the program goes
+// through the operator new below, so the benchmarks can check that running frames allocate nothing.
+// The workers of a JobSystem add theirs up in the JobSystem, see JobSystem::allocations.
+thread_local long long threadAllocations = 0;
+
+// the replacements are kept out of line, inlined into their callers the compiler would see memory
+// from malloc handed to delete and warn about mismatched allocations
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+NOINLINE void* operator new(size_t size) {
+	threadAllocations++;
+	void* p = malloc(size > 0 ? size : 1);
+	if (!p)
+		throw bad_alloc();
+	return p;
+}
+
+NOINLINE void operator delete(void* p) noexcept {
+	free(p);
+}
+
+NOINLINE void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
 // Coordinate class
 class Coord {
 public:
@@ -28,291 +89,3649 @@ public:
 	}
 };
 
-// Object base class
-class Object {
-private:
-	sf::RenderWindow* window;
-	sf::Texture texture;
-	sf::Sprite sprite;
-	Coord pos;
-
+// Directions quantized into a fixed number of steps of a full turn, with their cosines and sines
+// computed by the compiler. Step 0 points right and the steps turn counterclockwise, a quarter of
+// them pointing up. Firing looks the velocity of a bullet up here instead of calling cos and sin.
+class Directions {
 public:
-	// initializes the object
-	void init(sf::RenderWindow* window, string texturePath, Coord pos) {
-		this->window = window;
+	static const int count = 1024; // steps of a full turn, a power of two
+	float cosine[count];
+	float sine[count];
 
-		// load the object texture
-		if (!texturePath.empty()) {
-			texture.loadFromFile(texturePath);
-			texture.setSmooth(true);
-			sprite.setTexture(texture);
+public:
+	// constructor for the Directions class, runs at compile time
+	constexpr Directions() : cosine(), sine() {
+		// only the first quarter is summed up, the other quarters mirror it,
+		// so that the four axes come out as exactly 0 and 1
+		for (int i = 0; i <= count / 4; i++) {
+			float s = (float)series(2 * 3.14159265358979323846 * i / count);
+			sine[count / 2 + i] = -s;
+			sine[(count - i) % count] = -s;
+			sine[i] = s;
+			sine[count / 2 - i] = s;
 		}
+		for (int i = 0; i < count; i++)
+			cosine[i] = sine[(i + count / 4) % count];
+	}
 
-		if (sprite.getTexture()) {
-			// define the center point for the object
-			float x = sprite.getTexture()->getSize().x * 0.5f;
-			float y = sprite.getTexture()->getSize().y * 0.5f;
+	// returns the step closest to an angle in radians
+	static int quantize(float angle) {
+		return (int)floor(angle / (2 * pi) * count + 0.5f) & (count - 1);
+	}
 
-			// for sandbags and barrels, the center is higher
-			if (texturePath == "bags.png") y = sprite.getTexture()->getSize().y * 0.4f;
-			if (texturePath == "barrel.png") y = sprite.getTexture()->getSize().y * 0.3f;
+	// returns the angle of a step in radians
+	static float angle(int step) {
+		return step * 2 * pi / count;
+	}
 
-			sprite.setOrigin(x, y);
+private:
+	// sine of an angle between 0 and a quarter turn, as sin itself can not run at compile time
+	static constexpr double series(double x) {
+		double term = x;
+		double sum = x;
+		for (int n = 1; n < 12; n++) {
+			term *= -x * x / ((2 * n) * (2 * n + 1));
+			sum += term;
 		}
+		return sum;
+	}
+};
 
-		this->pos = pos;
+constexpr Directions directions;
+
+// One event of a trace: a phase of the game beginning or ending on a thread
+class TraceEvent {
+public:
+	const char* name; // a string literal, only the pointer is kept
+	char phase;       // 'B' when the phase begins, 'E' when it ends
+	long long time;   // microseconds since the tracer was started
+};
+
+// Events recorded by one thread. Only that thread writes, into a ring which keeps its latest
+// events, so recording takes no lock. A flush from another thread copies the events out and
+// then drops the ones the writer may have overwritten in the meantime.
+class TraceBuffer {
+public:
+	static const unsigned int capacity = 1 << 16; // a power of two, so the count may wrap around
+	TraceEvent events[capacity];
+	atomic<unsigned int> count; // events written so far, the ring holds the last capacity of them
+	int tid;
+	const char* threadName;
+
+public:
+	// constructor for the TraceBuffer class
+	TraceBuffer(int tid, const char* threadName) : count(0) {
+		this->tid = tid;
+		this->threadName = threadName;
 	}
 
-	// changes the sprite's texture
-	void setTexture(const sf::Texture& texture) {
-		sprite.setTexture(texture);
+	// records an event, only called by the buffer's thread
+	void add(const char* name, char phase, long long time) {
+		unsigned int n = count.load(memory_order_relaxed);
+		TraceEvent& e = events[n % capacity];
+		e.name = name;
+		e.phase = phase;
+		e.time = time;
+		count.store(n + 1, memory_order_release);
 	}
+};
 
-	// returns the sprite's texture
-	const sf::Texture* getTexture() {
-		return sprite.getTexture();
+// Records when the phases of the game begin and end on every thread, and writes them as a
+// Chrome trace (JSON) which chrome://tracing and Perfetto show as a timeline. While tracing is
+// off the macros below cost a single branch on a flag.
+class Tracer {
+public:
+	static atomic<bool> enabled;
+
+private:
+	mutex lock; // only taken when a thread records its first event and while writing a trace
+	vector<TraceBuffer*> buffers;
+	chrono::steady_clock::time_point origin;
+	string path;
+
+public:
+	// destructor for the Tracer class, writes the trace when the program exits
+	~Tracer() {
+		if (enabled)
+			flush();
+		for (size_t i = 0; i < buffers.size(); i++)
+			delete buffers[i];
 	}
 
-	// changes the object's position
-	void setPosition(float x, float y) {
-		pos.x = x;
-		pos.y = y;
+	// starts tracing, flush writes the trace to the path unless it is empty
+	void start(string path) {
+		this->path = path;
+		origin = chrono::steady_clock::now();
+		enabled = true;
 	}
 
-	// returns the object's position
-	Coord getPosition() {
-		return pos;
+	// returns the microseconds since tracing started
+	long long now() {
+		return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - origin).count();
 	}
 
-	// moves the object by a given offset
-	void move(float offsetX, float offsetY) {
-		pos.x += offsetX;
-		pos.y += offsetY;
+	// records the beginning of a phase on the calling thread
+	void begin(const char* name) {
+		local()->add(name, 'B', now());
 	}
 
-	// changes the object's angle
-	void setAngle(float radians) {
-		// convert radians to degrees
-		float degrees = radians / pi * 180;
-		sprite.setRotation(degrees);
+	// records the end of a phase on the calling thread
+	void end(const char* name) {
+		local()->add(name, 'E', now());
 	}
 
-	// draws the object's sprite
-	void paint() {
-		sprite.setPosition(pos.x, pos.y);
-		window->draw(sprite);
+	// names the calling thread in the trace
+	static void nameThread(const char* name) {
+		threadName() = name;
 	}
 
-	// checks whether object collides with another object
-	bool collideObject(Object& other) {
-		// distance-based check
-		float dx = pos.x - other.pos.x;
-		float dy = pos.y - other.pos.y;
-		float distance = sqrt(dx * dx + dy * dy);
-		return distance < 30;
+	// writes everything recorded so far to the path given to start, returns false on failure
+	bool flush() {
+		return !path.empty() && write(path, 0);
 	}
 
-	// checks whether the object is inside the window
-	bool insideWindow(float border) {
-		if (pos.x < border || pos.x > 1024 - border)
-			return false;
-		if (pos.y < border || pos.y > 768 - border)
+	// writes the events recorded since a time to a file, returns false on failure
+	bool write(string path, long long since) {
+		ofstream file(path.c_str());
+		if (!file)
 			return false;
-		return true;
+		lock_guard<mutex> guard(lock);
+		vector<TraceEvent> copy(TraceBuffer::capacity);
+		file << "{\"traceEvents\":[";
+		bool first = true;
+		for (size_t b = 0; b < buffers.size(); b++) {
+			TraceBuffer* buffer = buffers[b];
+			file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+				<< ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+			first = false;
+
+			// copy the ring, then keep only what the writer can not have overwritten while copying,
+			// counting the event it may have been in the middle of writing
+			unsigned int end = buffer->count.load(memory_order_acquire);
+			unsigned int n = end < TraceBuffer::capacity ? end : TraceBuffer::capacity;
+			for (unsigned int i = end - n; i != end; i++)
+				copy[i % TraceBuffer::capacity] = buffer->events[i % TraceBuffer::capacity];
+			unsigned int written = buffer->count.load(memory_order_acquire) - end + 1;
+			unsigned int room = TraceBuffer::capacity - n;
+			unsigned int lost = written > room ? written - room : 0;
+			unsigned int start = end - n + (lost < n ? lost : n);
+
+			// a phase whose beginning fell out of the ring is left out
+			int depth = 0;
+			for (unsigned int i = start; i != end; i++) {
+				const TraceEvent& e = copy[i % TraceBuffer::capacity];
+				if (e.time < since || (e.phase == 'E' && depth == 0))
+					continue;
+				depth += e.phase == 'B' ? 1 : -1;
+				file << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase << "\",\"ts\":" << e.time
+					<< ",\"pid\":1,\"tid\":" << buffer->tid << "}";
+			}
+		}
+		file << "\n]}\n";
+		return (bool)file;
+	}
+
+	// returns the tracer of the program
+	static Tracer& instance() {
+		static Tracer tracer;
+		return tracer;
+	}
+
+private:
+	// returns the name the calling thread is traced under
+	static const char*& threadName() {
+		thread_local const char* name = "thread";
+		return name;
 	}
-};
 
-// Sandbag class inherits from base Object class
-class Sandbag : public Object {
+	// returns the buffer of the calling thread, created with its first event
+	TraceBuffer* local() {
+		thread_local TraceBuffer* buffer = nullptr;
+		if (!buffer) {
+			lock_guard<mutex> guard(lock);
+			buffer = new TraceBuffer((int)buffers.size(), threadName());
+			buffers.push_back(buffer);
+		}
+		return buffer;
+	}
 };
 
-// Barrel class inherits from base Object class
-class Barrel : public Object {
+atomic<bool> Tracer::enabled(false);
+
+// marks the beginning and the end of a phase in the trace, the name must be a string literal
+#define TRACE_BEGIN(name) do { if (Tracer::enabled.load(memory_order_relaxed)) Tracer::instance().begin(name); } while (0)
+#define TRACE_END(name) do { if (Tracer::enabled.load(memory_order_relaxed)) Tracer::instance().end(name); } while (0)
+
+// Read-only view of a whole file, the operating system pages it in when it is first touched
+// and may drop the pages again when memory gets low
+class MappedFile {
 private:
-	bool isVisible;
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;
+#endif
 
 public:
-	// constructor for the Barrel class
-	Barrel() {
-		isVisible = true;
+	// constructor for the MappedFile class
+	MappedFile() {
+		data = nullptr;
+		size = 0;
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#else
+		file = -1;
+#endif
+	}
+
+	// destructor for the MappedFile class
+	~MappedFile() {
+		close();
+	}
+
+	// maps the file, returns false if it can not be opened
+	bool open(string path) {
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+			return false;
+		size = (size_t)fileSize.QuadPart;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapping)
+			return false;
+		data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat info;
+		if (fstat(file, &info) != 0 || info.st_size == 0)
+			return false;
+		size = (size_t)info.st_size;
+		void* view = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+		data = view == MAP_FAILED ? nullptr : (const char*)view;
+#endif
+		return data != nullptr;
+	}
+
+	// unmaps the file
+	void close() {
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = NULL;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data)
+			munmap((void*)data, size);
+		if (file >= 0)
+			::close(file);
+		file = -1;
+#endif
+		data = nullptr;
+		size = 0;
 	}
 
-	// returns isVisible attribute of barrel
-	bool getVisible() {
-		return isVisible;
+	// returns the contents of the file
+	const char* getData() {
+		return data;
 	}
 
-	// hides or shows the barrel
-	void setVisible(bool visible) {
-		isVisible = visible;
+	// returns the size of the file
+	size_t getSize() {
+		return size;
 	}
 };
 
-// Player class inherits from base Object class
-class Player : public Object {
+// LZ4 block compression, the block format only without the frame around it. A block is a chain
+// of sequences, each a token, literal bytes copied as they are, and a match copied from the
+// output written so far; the last sequence has literals only.
+class Lz4 {
+public:
+	// appends the compressed form of n bytes to out
+	static void compress(const unsigned char* src, size_t n, vector<unsigned char>& out) {
+		// the last match has to start 12 bytes and end 5 bytes before the end of the block
+		vector<int> table(1 << 14, -1); // last position of every hashed 4 byte sequence
+		size_t anchor = 0;
+		size_t i = 0;
+		while (n >= 13 && i + 12 < n) {
+			unsigned int sequence;
+			memcpy(&sequence, src + i, 4);
+			unsigned int h = (sequence * 2654435761u) >> 18;
+			int candidate = table[h];
+			table[h] = (int)i;
+			if (candidate < 0 || i - candidate > 65535 || memcmp(src + candidate, src + i, 4) != 0) {
+				i++;
+				continue;
+			}
+			size_t length = 4;
+			while (i + length < n - 5 && src[candidate + length] == src[i + length])
+				length++;
+			writeSequence(out, src + anchor, i - anchor, i - candidate, length);
+			i += length;
+			anchor = i;
+		}
+		writeSequence(out, src + anchor, n - anchor, 0, 0);
+	}
+
+	// decompresses a block of n bytes into exactly size bytes at dst, returns false if the block
+	// is damaged and would read or write out of bounds
+	static bool decompress(const unsigned char* src, size_t n, unsigned char* dst, size_t size) {
+		size_t i = 0;
+		size_t o = 0;
+		while (i < n) {
+			unsigned int token = src[i++];
+			size_t literals = token >> 4;
+			if (!readLength(src, n, i, literals) || literals > n - i || literals > size - o)
+				return false;
+			memcpy(dst + o, src + i, literals);
+			i += literals;
+			o += literals;
+			if (i == n)
+				break;
+
+			if (n - i < 2)
+				return false;
+			size_t offset = src[i] | src[i + 1] << 8;
+			i += 2;
+			size_t length = token & 15;
+			if (offset == 0 || offset > o || !readLength(src, n, i, length))
+				return false;
+			length += 4;
+			if (length > size - o)
+				return false;
+			// the match may overlap the bytes it writes, a run repeats its first bytes
+			for (size_t k = 0; k < length; k++, o++)
+				dst[o] = dst[o - offset];
+		}
+		return o == size;
+	}
+
 private:
-	sf::Texture textures[14];
-	int score;
-	int bulletState; // state of the player when the bullet was fired
+	// appends literals followed by a match, or the literals alone when length is 0
+	static void writeSequence(vector<unsigned char>& out, const unsigned char* literals, size_t numLiterals, size_t offset, size_t length) {
+		size_t matchLength = length > 0 ? length - 4 : 0;
+		out.push_back((unsigned char)((numLiterals < 15 ? numLiterals : 15) << 4 | (matchLength < 15 ? matchLength : 15)));
+		writeLength(out, numLiterals);
+		out.insert(out.end(), literals, literals + numLiterals);
+		if (length == 0)
+			return;
+		out.push_back((unsigned char)(offset & 255));
+		out.push_back((unsigned char)(offset >> 8));
+		writeLength(out, matchLength);
+	}
 
+	// appends the rest of a length which did not fit into its 4 bits of the token
+	static void writeLength(vector<unsigned char>& out, size_t length) {
+		if (length < 15)
+			return;
+		for (length -= 15; length >= 255; length -= 255)
+			out.push_back(255);
+		out.push_back((unsigned char)length);
+	}
+
+	// adds the rest of a length to the 4 bits of it in the token, returns false at the end of the block
+	static bool readLength(const unsigned char* src, size_t n, size_t& i, size_t& length) {
+		if (length < 15)
+			return true;
+		unsigned int b;
+		do {
+			if (i >= n)
+				return false;
+			b = src[i++];
+			length += b;
+		} while (b == 255);
+		return true;
+	}
+};
+
+// Asset bundle file layout: the header, the entries, the path pool and then the data of every
+// entry, each starting at a multiple of 16 bytes
+class BundleHeader {
 public:
-	enum WalkDirection { Left, Up, Right, Down };
+	char magic[4];             // "BAST"
+	unsigned int version;
+	unsigned int numEntries;
+	unsigned int stringBytes;  // size of the path pool after the entries
+};
 
-	// initializes the player
-	void init(sf::RenderWindow* window, Coord pos) {
+class BundleEntry {
+public:
+	enum Kind { ImageKind, FileKind };
 
-		// load textures
-		textures[0].loadFromFile("soldier0.png");
-		textures[1].loadFromFile("soldier1.png");
-		textures[2].loadFromFile("soldier2.png");
-		textures[3].loadFromFile("soldier3.png");
-		textures[4].loadFromFile("soldier4.png");
-		textures[5].loadFromFile("soldier5.png");
-		textures[6].loadFromFile("soldier6.png");
-		textures[7].loadFromFile("soldier7.png");
-		textures[8].loadFromFile("soldier8.png");
-		textures[9].loadFromFile("soldier9.png");
-		textures[10].loadFromFile("soldier10.png");
-		textures[11].loadFromFile("soldier11.png");
-		textures[12].loadFromFile("soldier12.png");
-		textures[13].loadFromFile("soldier13.png");
-		setTexture(textures[0]);
+	unsigned int kind;
+	unsigned int path;         // offset of the path in the pool
+	unsigned int width;        // of an image, whose data are width * height RGBA pixels
+	unsigned int height;
+	unsigned int compressed;   // 1 if the data are an LZ4 block, see Lz4
+	unsigned int storedBytes;  // size of the data in the file
+	unsigned int rawBytes;     // size of the data once decompressed
+	unsigned int offset;       // of the data from the start of the file
+	long long sourceBytes;     // size and modification time of the file the entry was made from,
+	long long sourceTime;      // when it was packed
+};
 
-		// initialize base Object class
-		Object::init(window, string(), pos);
+// Assets baked into one mapped file by AssetPacker. Images are stored decoded, so a texture is
+// made by handing its pixels straight to the graphics card, without decoding a PNG. The paths are
+// the keys of the TextureCache: "barrel.png", or the ready made strip "barrel.png#damaged3" and
+// atlas "bullet.png#atlas32". An entry whose file changed since it was packed is not used, the
+// file is loaded instead, so a bundle which was not packed again never hides a new image.
+class AssetBundle {
+private:
+	MappedFile file;
+	const BundleHeader* header; // null when no bundle is open
+	const BundleEntry* entries;
+	const char* strings;
+	map<string, vector<char> > files; // decompressed files, fonts read from them for as long as they live
+	mutex lock;
 
-		score = 0;
-		bulletState = 1;
+public:
+	// constructor for the AssetBundle class
+	AssetBundle() {
+		header = nullptr;
+		entries = nullptr;
+		strings = nullptr;
 	}
 
-	// checks whether player collides with one of the other objects
-	bool checkCollision(Barrel* barrels, Sandbag* sandbags, int nb, int ns) {
+	// maps a bundle and checks its entries, returns false with a message if it can not be used
+	bool open(string path, string& error) {
+		header = nullptr;
+		if (!file.open(path)) {
+			error = "can not map " + path;
+			return false;
+		}
+		const char* data = file.getData();
+		size_t size = file.getSize();
+		const BundleHeader* h = (const BundleHeader*)data;
+		if (size < sizeof(BundleHeader) || memcmp(h->magic, "BAST", 4) != 0) {
+			error = path + ": not an asset bundle";
+			return false;
+		}
+		if (h->version != 2) {
+			error = path + ": unsupported version, pack it again";
+			return false;
+		}
+		if (h->numEntries > 1 << 16 || h->stringBytes > 1 << 20
+			|| size < sizeof(BundleHeader) + (size_t)h->numEntries * sizeof(BundleEntry) + h->stringBytes) {
+			error = path + ": file is too short";
+			return false;
+		}
+		const BundleEntry* e = (const BundleEntry*)(h + 1);
+		const char* pool = (const char*)(e + h->numEntries);
+		if (h->stringBytes == 0 || pool[h->stringBytes - 1] != 0) {
+			error = path + ": invalid path pool";
+			return false;
+		}
+		for (unsigned int i = 0; i < h->numEntries; i++) {
+			bool image = e[i].kind == BundleEntry::ImageKind;
+			bool ok = (image || e[i].kind == BundleEntry::FileKind) && e[i].path < h->stringBytes
+				&& (size_t)e[i].offset + e[i].storedBytes <= size && e[i].rawBytes > 0
+				&& (e[i].compressed || e[i].storedBytes == e[i].rawBytes);
+			if (ok && image)
+				ok = e[i].width > 0 && e[i].height > 0 && e[i].width <= 1 << 14 && e[i].height <= 1 << 14
+					&& e[i].rawBytes == e[i].width * e[i].height * 4;
+			if (!ok) {
+				error = path + ": invalid entry " + to_string(i);
+				return false;
+			}
+		}
 
-		// collide the player with sandbags
-		for (int i = 0; i < ns; i++)
-			if (collideObject(sandbags[i]))
-				return true;
+		header = h;
+		entries = e;
+		strings = pool;
+		return true;
+	}
 
-		// collide the player with visible barrels
-		for (int i = 0; i < nb; i++)
-			if (barrels[i].getVisible() && collideObject(barrels[i]))
-				return true;
+	// makes the texture out of the image stored under the key, returns false if there is none
+	bool loadTexture(string key, sf::Texture& texture) {
+		const BundleEntry* e = find(key, BundleEntry::ImageKind);
+		vector<char> decompressed;
+		const char* pixels = e && isFresh(*e) ? getPixels(*e, decompressed) : nullptr;
+		if (!pixels || !texture.create(e->width, e->height))
+			return false;
+		TRACE_BEGIN("AssetBundle::upload");
+		texture.update((const sf::Uint8*)pixels);
+		TRACE_END("AssetBundle::upload");
+		return true;
+	}
 
-		return false;
+	// copies the image stored under the key, returns false if there is none
+	bool loadImage(string key, sf::Image& image) {
+		const BundleEntry* e = find(key, BundleEntry::ImageKind);
+		vector<char> decompressed;
+		const char* pixels = e && isFresh(*e) ? getPixels(*e, decompressed) : nullptr;
+		if (!pixels)
+			return false;
+		image.create(e->width, e->height, (const sf::Uint8*)pixels);
+		return true;
 	}
 
-	// sets the current score of the player
-	void setScore(int score) {
-		this->score = score;
+	// loads the font from the bundle, or from its file when the bundle does not have it
+	bool loadFont(string path, sf::Font& font) {
+		const BundleEntry* e = find(path, BundleEntry::FileKind);
+		if (!e || !isFresh(*e))
+			return font.loadFromFile(path);
+		if (!e->compressed)
+			return font.loadFromMemory(file.getData() + e->offset, e->storedBytes);
+
+		lock_guard<mutex> guard(lock);
+		vector<char>& data = files[path];
+		if (data.empty()) {
+			data.resize(e->rawBytes);
+			if (!decompress(*e, &data[0])) {
+				files.erase(path);
+				return font.loadFromFile(path);
+			}
+		}
+		return font.loadFromMemory(&data[0], data.size());
 	}
 
-	// increments score of the player
-	void incrementScore() {
-		score++;
+	// returns the bundle shared by all objects, empty until it is opened
+	static AssetBundle& instance() {
+		static AssetBundle bundle;
+		return bundle;
 	}
 
-	// returns the current score of the player
-	int getScore() {
-		return score;
+	// returns the path of the file an entry is made from, its key without what follows a '#'
+	static string getSource(string key) {
+		return key.substr(0, key.find('#'));
 	}
 
-	// returns the state of the player when the bullet was fired
-	int getBulletState() {
-		return bulletState;
+	// reads the size and modification time of a file, returns false if it does not exist
+	static bool stamp(string path, long long& bytes, long long& time) {
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+			return false;
+		bytes = (long long)info.st_size;
+		time = (long long)info.st_mtime;
+		return true;
 	}
 
-	// returns a random number between a and b
-	float random(float a, float b) {
-		float r = (rand() % 1000) / 1000.0f;
-		return a + (b - a) * r;
+private:
+	// returns the entry of the key, or null
+	const BundleEntry* find(string key, unsigned int kind) {
+		if (!header)
+			return nullptr;
+		for (unsigned int i = 0; i < header->numEntries; i++)
+			if (entries[i].kind == kind && key == strings + entries[i].path)
+				return &entries[i];
+		return nullptr;
 	}
 
-	// respawns the object at random location
-	void respawn() {
-		const float border = 50;
-		float x = random(border, 1024 - border);
-		float y = random(border, 768 - border);
-		setPosition(x, y);
+	// returns false if the file of the entry changed since it was packed; without the file, as
+	// when only the bundle is shipped, the entry is used as it is
+	bool isFresh(const BundleEntry& e) {
+		string source = getSource(strings + e.path);
+		long long bytes, time;
+		if (!stamp(source, bytes, time) || (bytes == e.sourceBytes && time == e.sourceTime))
+			return true;
+		cerr << source << " changed since the asset bundle was packed, it is loaded from the file" << endl;
+		return false;
 	}
 
-	// soldier walk function for 4 directions. Last texture checking in for loop, next state decided according to that.
-	void walk(float speed, WalkDirection dir) {
-		if (dir == Up) {
-			for (int i = 0; i < 14; i++) {
-				if (getTexture() == &textures[i]) {
-					if (i == 0) {
-						setTexture(textures[8]);
-						break;
-					}if (i == 1) {
-						setTexture(textures[0]);
-						break;
-					}if (i == 2) {
-						setTexture(textures[1]);
-						break;
-					}if (i == 3) {
-						setTexture(textures[2]);
-						break;
-					}if (i == 4) {
-						setTexture(textures[5]);
-						break;
-					}if (i == 5) {
-						setTexture(textures[6]);
-						break;
-					}if (i == 6) {
-						setTexture(textures[0]);
-						break;
-					}if (i == 7) {
-						setTexture(textures[8]);
-						break;
-					}if (i == 8) {
-						setTexture(textures[7]);
-						break;
-					}if (i == 9) {
-						setTexture(textures[2]);
-						break;
-					}if (i == 10) {
-						setTexture(textures[1]);
-						break;
-					}if (i == 11) {
-						setTexture(textures[5]);
-						break;
-					}if (i == 12) {
-						setTexture(textures[7]);
-						break;
-					}if (i == 13) {
-						setTexture(textures[12]);
-						break;
-					}
-				}
-			}
+	// decompresses the data of an entry into its rawBytes at dst
+	bool decompress(const BundleEntry& e, char* dst) {
+		TRACE_BEGIN("AssetBundle::decompress");
+		bool ok = Lz4::decompress((const unsigned char*)file.getData() + e.offset, e.storedBytes, (unsigned char*)dst, e.rawBytes);
+		TRACE_END("AssetBundle::decompress");
+		if (!ok)
+			cerr << strings + e.path << " is damaged in the asset bundle" << endl;
+		return ok;
+	}
 
-			move(0, -speed);
+	// returns the pixels of an image entry, decompressed into the buffer if needed, or null
+	const char* getPixels(const BundleEntry& e, vector<char>& decompressed) {
+		if (!e.compressed)
+			return file.getData() + e.offset;
+		decompressed.resize(e.rawBytes);
+		return decompress(e, &decompressed[0]) ? &decompressed[0] : nullptr;
+	}
+};
+
+// Texture cache so that objects sharing an image share one texture. It also knows which textures
+// were made from which file, including textures owned elsewhere which are tracked here, so that a
+// changed file can be loaded into all of them again, see HotReloader.
+class TextureCache {
+public:
+	// texture made from a file, with the number of damage states if it is a strip of them
+	class Source {
+	public:
+		sf::Texture* texture;
+		int states;
+	};
+
+	// image decoded ahead of time for a texture which is not made yet, see decode
+	class Decoded {
+	public:
+		string key;
+		sf::Image image;
+	};
+
+private:
+	map<string, sf::Texture*> textures;
+	vector<pair<string, sf::Texture*> > tracked;
+	map<const sf::Texture*, sf::Image> images; // pixels of the textures when offscreen
+	bool offscreen;
+	mutex lock; // textures may be looked up from the thread reloading them
+
+public:
+	// constructor for the TextureCache class
+	TextureCache() {
+		offscreen = false;
+	}
 
+	// destructor for the TextureCache class
+	~TextureCache() {
+		for (map<string, sf::Texture*>::iterator it = textures.begin(); it != textures.end(); ++it)
+			delete it->second;
+	}
+
+	// returns the texture for the path, loading it on first use, from the AssetBundle if it has it
+	sf::Texture* get(string path) {
+		lock_guard<mutex> guard(lock);
+		sf::Texture*& texture = textures[path];
+		if (!texture) {
+			TRACE_BEGIN("TextureCache::load");
+			texture = new sf::Texture;
+			loadFile(path, *texture);
+			texture->setSmooth(true);
+			TRACE_END("TextureCache::load");
 		}
-		else if (dir == Down) {
-			for (int i = 0; i < 14; i++) {
-				if (getTexture() == &textures[i]) {
-					if (i == 0) {
-						setTexture(textures[1]);
-						break;
-					}if (i == 1) {
-						setTexture(textures[2]);
-						break;
-					}if (i == 2) {
-						setTexture(textures[3]);
-						break;
-					}if (i == 3) {
-						setTexture(textures[11]);
+		return texture;
+	}
+
+	// returns the texture for the path followed by states - 1 copies of it looking more and more
+	// damaged, side by side
+	sf::Texture* getDamaged(string path, int states) {
+		lock_guard<mutex> guard(lock);
+		string key = path + "#damaged" + to_string(states);
+		sf::Texture*& texture = textures[key];
+		if (!texture) {
+			TRACE_BEGIN("TextureCache::damage");
+			texture = new sf::Texture;
+			// a bundle holds the strip ready made
+			if (!loadBundled(key, *texture)) {
+				sf::Image image;
+				image.loadFromFile(path);
+				sf::Image strip;
+				damage(image, states, strip);
+				loadImage(strip, *texture);
+			}
+			texture->setSmooth(true);
+			TRACE_END("TextureCache::damage");
+		}
+		return texture;
+	}
+
+	// decodes the image get(path) would make a texture of, or getDamaged(path, states) for more
+	// than one state, unless that texture is made already; returns false if there is nothing to add
+	// it uploads nothing, so another thread may decode what the thread drawing the frames adds
+	bool decode(string path, int states, Decoded& decoded) {
+		decoded.key = states > 1 ? path + "#damaged" + to_string(states) : path;
+		{
+			lock_guard<mutex> guard(lock);
+			if (textures.count(decoded.key))
+				return false;
+		}
+		TRACE_BEGIN("TextureCache::decode");
+		bool loaded = AssetBundle::instance().loadImage(decoded.key, decoded.image);
+		if (!loaded && states > 1) {
+			sf::Image image;
+			loaded = image.loadFromFile(path);
+			if (loaded)
+				damage(image, states, decoded.image);
+		}
+		else if (!loaded)
+			loaded = decoded.image.loadFromFile(path);
+		TRACE_END("TextureCache::decode");
+		return loaded;
+	}
+
+	// makes the texture of a decoded image, which get or getDamaged then return
+	void add(const Decoded& decoded) {
+		lock_guard<mutex> guard(lock);
+		sf::Texture*& texture = textures[decoded.key];
+		if (texture)
+			return;
+		texture = new sf::Texture;
+		loadImage(decoded.image, *texture);
+		texture->setSmooth(true);
+	}
+
+	// keeps only the pixels of the textures loaded from now on, which never go to the graphics
+	// card; a game can then draw without a window, into a SoftwareRenderer, see addPixels
+	void setOffscreen(bool on) {
+		offscreen = on;
+	}
+
+	// makes a texture owned by somebody else out of the file at the path, from the AssetBundle if
+	// it has it; returns false if it can not be loaded
+	bool load(string path, sf::Texture& texture) {
+		lock_guard<mutex> guard(lock);
+		return loadFile(path, texture);
+	}
+
+	// makes a texture owned by somebody else out of the image stored under the key in the
+	// AssetBundle, returns false if there is none
+	bool loadFromBundle(string key, sf::Texture& texture) {
+		lock_guard<mutex> guard(lock);
+		return loadBundled(key, texture);
+	}
+
+	// makes a texture owned by somebody else out of the image
+	bool loadFromImage(const sf::Image& image, sf::Texture& texture) {
+		lock_guard<mutex> guard(lock);
+		return loadImage(image, texture);
+	}
+
+	// returns the size of a texture, also of one which only has its pixels
+	sf::Vector2u getSize(const sf::Texture& texture) {
+		if (!offscreen)
+			return texture.getSize();
+		lock_guard<mutex> guard(lock);
+		map<const sf::Texture*, sf::Image>::iterator it = images.find(&texture);
+		return it != images.end() ? it->second.getSize() : texture.getSize();
+	}
+
+	// calls add(texture, image) for every texture which only has its pixels
+	template <class F>
+	void addPixels(F add) {
+		lock_guard<mutex> guard(lock);
+		for (map<const sf::Texture*, sf::Image>::iterator it = images.begin(); it != images.end(); ++it)
+			add(it->first, it->second);
+	}
+
+	// remembers that a texture owned by somebody else was loaded from the path
+	void track(string path, sf::Texture* texture) {
+		lock_guard<mutex> guard(lock);
+		tracked.push_back(make_pair(path, texture));
+	}
+
+	// forgets the n textures starting at the address, before they are destroyed
+	void untrack(sf::Texture* first, int n) {
+		lock_guard<mutex> guard(lock);
+		size_t kept = 0;
+		for (size_t i = 0; i < tracked.size(); i++)
+			if (tracked[i].second < first || tracked[i].second >= first + n)
+				tracked[kept++] = tracked[i];
+		tracked.resize(kept);
+		for (int i = 0; i < n; i++)
+			images.erase(first + i);
+	}
+
+	// adds the textures made from the file at the path to sources
+	void find(string path, vector<Source>& sources) {
+		lock_guard<mutex> guard(lock);
+		string strip = path + "#damaged";
+		for (map<string, sf::Texture*>::iterator it = textures.begin(); it != textures.end(); ++it) {
+			Source source;
+			source.texture = it->second;
+			source.states = 1;
+			if (it->first.compare(0, strip.size(), strip) == 0)
+				source.states = atoi(it->first.c_str() + strip.size());
+			else if (it->first != path)
+				continue;
+			sources.push_back(source);
+		}
+		for (size_t i = 0; i < tracked.size(); i++) {
+			if (tracked[i].first == path) {
+				Source source;
+				source.texture = tracked[i].second;
+				source.states = 1;
+				sources.push_back(source);
+			}
+		}
+	}
+
+	// adds the paths of all files textures were made from to paths
+	void getPaths(set<string>& paths) {
+		lock_guard<mutex> guard(lock);
+		for (map<string, sf::Texture*>::iterator it = textures.begin(); it != textures.end(); ++it)
+			paths.insert(it->first.substr(0, it->first.find('#')));
+		for (size_t i = 0; i < tracked.size(); i++)
+			paths.insert(tracked[i].first);
+	}
+
+	// makes the strip of getDamaged out of an image
+	static void damage(const sf::Image& image, int states, sf::Image& strip) {
+		sf::Vector2u size = image.getSize();
+		strip.create(size.x * states, size.y, sf::Color::Transparent);
+		for (int k = 0; k < states; k++) {
+			for (unsigned int y = 0; y < size.y; y++) {
+				for (unsigned int x = 0; x < size.x; x++) {
+					// darker with every state, and scorched in more and more 4x4 blocks, the
+					// blocks of a state staying scorched in the next ones
+					unsigned int h = (x / 4) * 73856093u ^ (y / 4) * 19349663u;
+					h = h * 1103515245u + 12345u;
+					float shade = 1 - 0.15f * k;
+					if ((int)((h >> 16) % 100) < 15 * k)
+						shade *= 0.3f;
+					sf::Color c = image.getPixel(x, y);
+					strip.setPixel(k * size.x + x, y, sf::Color((sf::Uint8)(c.r * shade), (sf::Uint8)(c.g * shade), (sf::Uint8)(c.b * shade), c.a));
+				}
+			}
+		}
+	}
+
+	// returns the cache shared by all objects
+	static TextureCache& instance() {
+		static TextureCache cache;
+		return cache;
+	}
+
+private:
+	// makes the texture out of the file at the path, from the AssetBundle if it has it
+	bool loadFile(string path, sf::Texture& texture) {
+		if (loadBundled(path, texture))
+			return true;
+		if (!offscreen)
+			return texture.loadFromFile(path);
+		sf::Image image;
+		return image.loadFromFile(path) && loadImage(image, texture);
+	}
+
+	// makes the texture out of the image stored under the key in the AssetBundle, returns false
+	// if there is none
+	bool loadBundled(string key, sf::Texture& texture) {
+		if (!offscreen)
+			return AssetBundle::instance().loadTexture(key, texture);
+		sf::Image image;
+		return AssetBundle::instance().loadImage(key, image) && loadImage(image, texture);
+	}
+
+	// makes the texture out of the image, offscreen it only keeps the pixels
+	bool loadImage(const sf::Image& image, sf::Texture& texture) {
+		if (!offscreen)
+			return texture.loadFromImage(image);
+		images[&texture] = image;
+		return true;
+	}
+};
+
+// Target the draw calls of a frame are replayed into. The window is one, a software rasterizer
+// which needs no graphics card is another, so that frames can be checked pixel by pixel.
+class Renderer {
+public:
+	// destructor for the Renderer class
+	virtual ~Renderer() {}
+
+	// starts a frame filled with the color
+	virtual void clear(sf::Color color) = 0;
+
+	// the following quads go through the view
+	virtual void setView(const sf::View& view) = 0;
+
+	// draws quads of four vertices each, the texture coordinates are in pixels and texture may be null
+	virtual void drawQuads(const sf::Vertex* vertices, size_t count, const sf::Texture* texture) = 0;
+
+	// draws a line of text at a position of the target, regardless of the view
+	virtual void drawText(const char* str, sf::Vector2f pos) = 0;
+
+	// completes the frame
+	virtual void finish() {}
+};
+
+// Renderer drawing into the window with SFML
+class WindowRenderer : public Renderer {
+private:
+	sf::RenderWindow* window;
+	sf::Text* text; // font settings of the texts
+
+public:
+	// constructor for the WindowRenderer class
+	WindowRenderer(sf::RenderWindow* window, sf::Text* text) {
+		this->window = window;
+		this->text = text;
+	}
+
+	// starts a frame filled with the color
+	void clear(sf::Color color) {
+		window->clear(color);
+	}
+
+	// the following quads go through the view
+	void setView(const sf::View& view) {
+		window->setView(view);
+	}
+
+	// draws quads of four vertices each
+	void drawQuads(const sf::Vertex* vertices, size_t count, const sf::Texture* texture) {
+		window->draw(vertices, count, sf::Quads, texture);
+	}
+
+	// draws a line of text at a position of the window
+	void drawText(const char* str, sf::Vector2f pos) {
+		window->setView(window->getDefaultView());
+		text->setString(str);
+		text->setPosition(pos);
+		window->draw(*text);
+	}
+};
+
+// Header of a draw capture file, a recording of the frames a game drew. It is followed by
+// records, each one a CaptureRecord kind and then a texture or a frame
+class CaptureHeader {
+public:
+	char magic[4];         // "BDRW"
+	unsigned int version;
+	unsigned int width;    // size of the window the frames were drawn into
+	unsigned int height;
+};
+
+class CaptureRecord {
+public:
+	enum Kind { TextureRecord = 1, FrameRecord = 2 };
+	unsigned int kind;
+};
+
+// texture of a capture, followed by width * height RGBA pixels; the frames refer to it by its id
+class CaptureTexture {
+public:
+	unsigned int id;
+	unsigned int width;
+	unsigned int height;
+	unsigned int smooth;
+	unsigned int repeated;
+};
+
+// frame of a capture, followed by its views, batches, vertices and texts, see DrawList::write
+class CaptureFrame {
+public:
+	unsigned int numViews;
+	unsigned int numBatches;
+	unsigned int numVertices;
+	unsigned int numTexts;
+	unsigned int textBytes;
+};
+
+class CaptureView {
+public:
+	float center[2];
+	float size[2];
+	float rotation;
+	float viewport[4];
+};
+
+class CaptureBatch {
+public:
+	int texture;           // id of the texture, -1 for none
+	int view;
+	unsigned int first;
+	unsigned int count;
+};
+
+// Draw calls of one frame. The game records its frame into a draw list, which is replayed into
+// the window afterwards, possibly on another thread. Everything is drawn as textured quads, and
+// consecutive quads with the same texture and view are drawn with a single call.
+class DrawList {
+private:
+	class Batch {
+	public:
+		const sf::Texture* texture;
+		int view;
+		size_t first; // first vertex of the batch
+		size_t count;
+	};
+
+	vector<sf::Vertex> vertices;
+	vector<Batch> batches;
+	vector<sf::View> views;
+	vector<char> textChars;            // texts are drawn last, over everything, in window coordinates
+	vector<size_t> textStarts;         // offset of each text in textChars
+	vector<sf::Vector2f> textPositions;
+
+public:
+	// forgets all recorded draw calls, keeping the memory for the next frame
+	void clear() {
+		vertices.clear();
+		batches.clear();
+		views.clear();
+		textChars.clear();
+		textStarts.clear();
+		textPositions.clear();
+	}
+
+	// exchanges the recorded frames of two lists
+	void swap(DrawList& other) {
+		vertices.swap(other.vertices);
+		batches.swap(other.batches);
+		views.swap(other.views);
+		textChars.swap(other.textChars);
+		textStarts.swap(other.textStarts);
+		textPositions.swap(other.textPositions);
+	}
+
+	// the following draw calls go through the view
+	void setView(const sf::View& view) {
+		views.push_back(view);
+	}
+
+	// records a sprite
+	void draw(const sf::Sprite& sprite) {
+		if (!sprite.getTexture())
+			return;
+		sf::IntRect rect = sprite.getTextureRect();
+		const sf::Transform& transform = sprite.getTransform();
+		float w = (float)rect.width;
+		float h = (float)rect.height;
+		float u = (float)rect.left;
+		float v = (float)rect.top;
+
+		start(sprite.getTexture());
+		vertices.push_back(sf::Vertex(transform.transformPoint(0, 0), sf::Vector2f(u, v)));
+		vertices.push_back(sf::Vertex(transform.transformPoint(w, 0), sf::Vector2f(u + w, v)));
+		vertices.push_back(sf::Vertex(transform.transformPoint(w, h), sf::Vector2f(u + w, v + h)));
+		vertices.push_back(sf::Vertex(transform.transformPoint(0, h), sf::Vector2f(u, v + h)));
+		batches.back().count += 4;
+	}
+
+	// returns room for count quads drawn with the texture, to be filled by the caller
+	sf::Vertex* addQuads(const sf::Texture* texture, size_t count) {
+		start(texture);
+		size_t first = vertices.size();
+		vertices.resize(first + count * 4);
+		batches.back().count += count * 4;
+		return &vertices[first];
+	}
+
+	// records a vertex array made of quads, texture may be null for plain colors
+	void draw(const sf::VertexArray& quads, const sf::Texture* texture) {
+		size_t n = quads.getVertexCount();
+		if (n == 0)
+			return;
+		start(texture);
+		for (size_t i = 0; i < n; i++)
+			vertices.push_back(quads[i]);
+		batches.back().count += n;
+	}
+
+	// records a line of text at a position of the window
+	void drawText(const char* str, sf::Vector2f pos) {
+		textStarts.push_back(textChars.size());
+		textChars.insert(textChars.end(), str, str + strlen(str) + 1);
+		textPositions.push_back(pos);
+	}
+
+	// calls f with the texture of every batch
+	template <class F>
+	void forEachTexture(F f) {
+		for (size_t i = 0; i < batches.size(); i++)
+			if (batches[i].texture)
+				f(batches[i].texture);
+	}
+
+	// writes the recorded frame as a frame of a capture, ids are the capture's ids of the textures
+	void write(ostream& out, const map<const sf::Texture*, int>& ids) {
+		CaptureFrame h;
+		h.numViews = (unsigned int)views.size();
+		h.numBatches = (unsigned int)batches.size();
+		h.numVertices = (unsigned int)vertices.size();
+		h.numTexts = (unsigned int)textStarts.size();
+		h.textBytes = (unsigned int)textChars.size();
+		out.write((const char*)&h, sizeof(h));
+
+		for (size_t i = 0; i < views.size(); i++) {
+			const sf::View& v = views[i];
+			CaptureView cv = { { v.getCenter().x, v.getCenter().y }, { v.getSize().x, v.getSize().y }, v.getRotation(),
+				{ v.getViewport().left, v.getViewport().top, v.getViewport().width, v.getViewport().height } };
+			out.write((const char*)&cv, sizeof(cv));
+		}
+		for (size_t i = 0; i < batches.size(); i++) {
+			const Batch& b = batches[i];
+			CaptureBatch cb = { b.texture ? ids.find(b.texture)->second : -1, b.view, (unsigned int)b.first, (unsigned int)b.count };
+			out.write((const char*)&cb, sizeof(cb));
+		}
+		if (!vertices.empty())
+			out.write((const char*)&vertices[0], vertices.size() * sizeof(sf::Vertex));
+		for (size_t i = 0; i < textStarts.size(); i++) {
+			unsigned int start = (unsigned int)textStarts[i];
+			out.write((const char*)&start, sizeof(start));
+			out.write((const char*)&textPositions[i], sizeof(sf::Vector2f));
+		}
+		if (!textChars.empty())
+			out.write(&textChars[0], textChars.size());
+	}
+
+	// reads a frame of a capture written by write, textures[id] is the texture of each id
+	// returns false if the frame is cut off or does not make sense
+	bool read(istream& in, const vector<const sf::Texture*>& textures) {
+		clear();
+		CaptureFrame h;
+		if (!in.read((char*)&h, sizeof(h)))
+			return false;
+		if (h.numViews > 1024 || h.numVertices > (1u << 26) || h.textBytes > (1u << 20))
+			return false;
+
+		for (unsigned int i = 0; i < h.numViews && in; i++) {
+			CaptureView cv;
+			in.read((char*)&cv, sizeof(cv));
+			sf::View v(sf::Vector2f(cv.center[0], cv.center[1]), sf::Vector2f(cv.size[0], cv.size[1]));
+			v.setRotation(cv.rotation);
+			v.setViewport(sf::FloatRect(cv.viewport[0], cv.viewport[1], cv.viewport[2], cv.viewport[3]));
+			views.push_back(v);
+		}
+		for (unsigned int i = 0; i < h.numBatches && in; i++) {
+			CaptureBatch cb;
+			in.read((char*)&cb, sizeof(cb));
+			// frames never record empty batches, and replay needs a vertex at the start of each
+			if (cb.texture >= (int)textures.size() || cb.view >= (int)h.numViews || cb.first > h.numVertices || cb.count == 0 || cb.count > h.numVertices - cb.first)
+				return false;
+			Batch b;
+			b.texture = cb.texture >= 0 ? textures[cb.texture] : nullptr;
+			b.view = cb.view;
+			b.first = cb.first;
+			b.count = cb.count;
+			batches.push_back(b);
+		}
+		vertices.resize(h.numVertices);
+		if (h.numVertices > 0)
+			in.read((char*)&vertices[0], h.numVertices * sizeof(sf::Vertex));
+		for (unsigned int i = 0; i < h.numTexts && in; i++) {
+			unsigned int start;
+			sf::Vector2f pos;
+			in.read((char*)&start, sizeof(start));
+			in.read((char*)&pos, sizeof(pos));
+			if (start >= h.textBytes)
+				return false;
+			textStarts.push_back(start);
+			textPositions.push_back(pos);
+		}
+		textChars.resize(h.textBytes);
+		if (h.textBytes > 0) {
+			in.read(&textChars[0], h.textBytes);
+			textChars.back() = 0;
+		}
+		return (bool)in;
+	}
+
+	// draws the recorded frame with a renderer
+	void replay(Renderer& renderer) {
+		renderer.clear(sf::Color::Black);
+		int view = -1;
+		for (size_t i = 0; i < batches.size(); i++) {
+			const Batch& b = batches[i];
+			if (b.view != view && b.view >= 0) {
+				view = b.view;
+				renderer.setView(views[view]);
+			}
+			renderer.drawQuads(&vertices[b.first], b.count, b.texture);
+		}
+
+		for (size_t i = 0; i < textStarts.size(); i++)
+			renderer.drawText(&textChars[textStarts[i]], textPositions[i]);
+		renderer.finish();
+	}
+
+private:
+	// continues the last batch if it has the same texture and view, otherwise starts a new one
+	void start(const sf::Texture* texture) {
+		int view = (int)views.size() - 1;
+		if (!batches.empty() && batches.back().texture == texture && batches.back().view == view)
+			return;
+		Batch b;
+		b.texture = texture;
+		b.view = view;
+		b.first = vertices.size();
+		b.count = 0;
+		batches.push_back(b);
+	}
+};
+
+// Memory for the temporary data of one tick. Allocating just moves a pointer forward, and all of
+// it is given back at once when the next tick starts, so transient containers cost no heap calls.
+// A tick which needs more than the arena holds gets heap blocks, and the arena grows at the reset.
+// The arena belongs to the thread running the ticks, jobs may only fill what it handed out.
+class FrameArena {
+private:
+	char* memory;
+	size_t capacity;
+	size_t used;
+	vector<char*> overflow; // heap blocks of the current tick
+	size_t overflowBytes;
+
+public:
+	// constructor for the FrameArena class
+	FrameArena(size_t capacity) {
+		memory = new char[capacity];
+		this->capacity = capacity;
+		used = 0;
+		overflowBytes = 0;
+	}
+
+	// destructor for the FrameArena class
+	~FrameArena() {
+		reset();
+		delete[] memory;
+	}
+
+	// returns memory for n objects of type T, valid until the next reset
+	template <class T>
+	T* allocate(size_t n) {
+		return (T*)allocate(n * sizeof(T), alignof(T));
+	}
+
+	// returns the given number of bytes, valid until the next reset
+	void* allocate(size_t bytes, size_t align) {
+		size_t start = (used + align - 1) & ~(align - 1);
+		if (start + bytes <= capacity) {
+			used = start + bytes;
+			return memory + start;
+		}
+		char* block = new char[bytes];
+		overflow.push_back(block);
+		overflowBytes += bytes;
+		return block;
+	}
+
+	// prints into memory of the arena like printf, the text lives until the next reset
+	const char* format(const char* pattern, ...) {
+		va_list args;
+		va_start(args, pattern);
+		int length = vsnprintf(nullptr, 0, pattern, args);
+		va_end(args);
+		char* text = allocate<char>(length + 1);
+		va_start(args, pattern);
+		vsnprintf(text, length + 1, pattern, args);
+		va_end(args);
+		return text;
+	}
+
+	// gives all memory back, called when a tick starts
+	void reset() {
+		if (!overflow.empty()) {
+			for (size_t i = 0; i < overflow.size(); i++)
+				delete[] overflow[i];
+			overflow.clear();
+			delete[] memory;
+			capacity = (capacity + overflowBytes) * 2;
+			memory = new char[capacity];
+			overflowBytes = 0;
+		}
+		used = 0;
+	}
+};
+
+// Allocator for standard containers which takes their memory from a FrameArena
+// a container using it must not outlive the tick it was created in
+template <class T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+	FrameArena* arena;
+
+public:
+	// constructor for the ArenaAllocator class
+	ArenaAllocator(FrameArena* arena) {
+		this->arena = arena;
+	}
+
+	// the same arena for another type, containers need it for their internal nodes
+	template <class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) {
+		arena = other.arena;
+	}
+
+	T* allocate(size_t n) {
+		return arena->allocate<T>(n);
+	}
+
+	// nothing to do, the arena is reset as a whole
+	void deallocate(T*, size_t) {
+	}
+
+	template <class U>
+	bool operator==(const ArenaAllocator<U>& other) const {
+		return arena == other.arena;
+	}
+
+	template <class U>
+	bool operator!=(const ArenaAllocator<U>& other) const {
+		return arena != other.arena;
+	}
+};
+
+// Vector of the current tick, see ArenaAllocator
+template <class T>
+using FrameVector = vector<T, ArenaAllocator<T> >;
+
+// Three buffers handed from one producer thread to one consumer thread without locks.
+// The producer fills the back buffer and swaps it with the middle one; the consumer swaps the
+// middle one with its front buffer whenever the middle one holds a newer frame. Neither side
+// ever waits for the other, the consumer simply skips the frames it was too slow for.
+template <class T>
+class TripleBuffer {
+private:
+	T buffers[3];
+	int back;           // only touched by the producer
+	int front;          // only touched by the consumer
+	atomic<int> middle; // index of the middle buffer, plus newFrame when the consumer has not seen it
+	enum { newFrame = 4 };
+
+public:
+	// constructor for the TripleBuffer class
+	TripleBuffer() : middle(1) {
+		back = 0;
+		front = 2;
+	}
+
+	// returns the buffer the producer fills
+	T& getBack() {
+		return buffers[back];
+	}
+
+	// hands the back buffer over to the consumer
+	void publish() {
+		back = middle.exchange(back | newFrame) & 3;
+	}
+
+	// takes the newest published buffer as the front buffer, returns false if there is none
+	bool update() {
+		if (!(middle.load() & newFrame))
+			return false;
+		front = middle.exchange(front) & 3;
+		return true;
+	}
+
+	// returns the buffer the consumer reads
+	T& getFront() {
+		return buffers[front];
+	}
+};
+
+// Pool of worker threads running the loops of a frame in parallel. A parallel loop is cut into
+// jobs of a few items which go into the queue of the calling thread; idle threads steal jobs from
+// the other queues, so a slow job never holds up the rest. Every job only writes the items of its
+// own range, so the results do not depend on which thread ran which job or in which order.
+class JobSystem {
+private:
+	class Job {
+	public:
+		void (*run)(void* fn, int begin, int end);
+		void* fn;
+		int begin;
+		int end;
+		atomic<int>* pending; // jobs of the loop which are not finished yet
+	};
+
+	// the owner takes its newest job from the back, thieves take the oldest one from the front
+	// the jobs sit in a ring which only ever grows, so queueing does not allocate once it is big enough
+	class Queue {
+	public:
+		mutex lock;
+		vector<Job> ring;
+		size_t head;
+		size_t count;
+
+		// constructor for the Queue class
+		Queue() {
+			head = 0;
+			count = 0;
+		}
+
+		void pushBack(const Job& job) {
+			if (count == ring.size()) {
+				vector<Job> bigger(count > 0 ? count * 2 : 64);
+				for (size_t i = 0; i < count; i++)
+					bigger[i] = ring[(head + i) % count];
+				ring.swap(bigger);
+				head = 0;
+			}
+			ring[(head + count) % ring.size()] = job;
+			count++;
+		}
+
+		Job popBack() {
+			count--;
+			return ring[(head + count) % ring.size()];
+		}
+
+		Job popFront() {
+			Job job = ring[head];
+			head = (head + 1) % ring.size();
+			count--;
+			return job;
+		}
+	};
+
+	int numWorkers;
+	thread* workers;
+	Queue* queues;           // queue 0 belongs to the threads which are not workers
+	mutex sleepLock;         // guards queued and stopping for sleeping workers
+	condition_variable wake;
+	atomic<int> queued;      // jobs waiting in all queues
+	atomic<long long> workerAllocations; // heap allocations made by the jobs run on the workers
+	bool stopping;
+
+public:
+	// constructor for the JobSystem class, the thread calling parallelFor works as well
+	JobSystem(int workers) : queued(0), workerAllocations(0) {
+		numWorkers = workers > 0 ? workers : 0;
+		stopping = false;
+		queues = new Queue[numWorkers + 1];
+		this->workers = new thread[numWorkers];
+		for (int i = 0; i < numWorkers; i++)
+			this->workers[i] = thread(&JobSystem::work, this, i + 1);
+	}
+
+	// destructor for the JobSystem class
+	~JobSystem() {
+		{
+			lock_guard<mutex> guard(sleepLock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (int i = 0; i < numWorkers; i++)
+			workers[i].join();
+		delete[] workers;
+		delete[] queues;
+	}
+
+	// returns the number of threads working on a loop
+	int getNumThreads() {
+		return numWorkers + 1;
+	}
+
+	// returns the heap allocations made so far by the calling thread and the workers of jobs,
+	// which may be null, so that the difference counts everything a step allocated
+	static long long allocations(JobSystem* jobs) {
+		return threadAllocations + (jobs ? jobs->workerAllocations.load(memory_order_relaxed) : 0);
+	}
+
+	// calls fn(begin, end) for ranges of at most grain items covering 0 up to count
+	// the ranges run on the workers of jobs, or one after another when jobs is null
+	template <class F>
+	static void parallelFor(JobSystem* jobs, int count, int grain, F fn) {
+		if (count <= 0)
+			return;
+		if (!jobs || jobs->numWorkers == 0 || count <= grain)
+			fn(0, count);
+		else jobs->schedule(count, grain, fn);
+	}
+
+private:
+	// queues the ranges of a loop and works on them until all are finished
+	template <class F>
+	void schedule(int count, int grain, F& fn) {
+		int q = queueOfThisThread();
+		int numJobs = (count + grain - 1) / grain;
+		atomic<int> pending(numJobs);
+
+		Job job;
+		job.run = [](void* fn, int begin, int end) { (*(F*)fn)(begin, end); };
+		job.fn = &fn;
+		job.pending = &pending;
+		{
+			lock_guard<mutex> guard(queues[q].lock);
+			for (int begin = 0; begin < count; begin += grain) {
+				job.begin = begin;
+				job.end = begin + grain < count ? begin + grain : count;
+				queues[q].pushBack(job);
+			}
+		}
+		{
+			lock_guard<mutex> guard(sleepLock);
+			queued += numJobs;
+		}
+		wake.notify_all();
+
+		// the jobs of other loops may be taken as well, nested loops finish sooner that way
+		while (pending > 0) {
+			if (take(q, job))
+				execute(job, q);
+			else this_thread::yield();
+		}
+	}
+
+	// returns the queue of the calling thread
+	int queueOfThisThread() {
+		thread::id self = this_thread::get_id();
+		for (int i = 0; i < numWorkers; i++)
+			if (workers[i].get_id() == self)
+				return i + 1;
+		return 0;
+	}
+
+	// takes a job from the own queue, otherwise steals one from another queue
+	bool take(int q, Job& job) {
+		for (int k = 0; k <= numWorkers; k++) {
+			Queue& queue = queues[(q + k) % (numWorkers + 1)];
+			lock_guard<mutex> guard(queue.lock);
+			if (queue.count == 0)
+				continue;
+			job = k == 0 ? queue.popBack() : queue.popFront();
+			queued--;
+			return true;
+		}
+		return false;
+	}
+
+	// runs a job on the thread of queue q and marks it finished
+	// the allocations of a worker are added up before the loop can see the job finished
+	void execute(Job& job, int q) {
+		long long before = threadAllocations;
+		job.run(job.fn, job.begin, job.end);
+		if (q > 0)
+			workerAllocations.fetch_add(threadAllocations - before, memory_order_relaxed);
+		(*job.pending)--;
+	}
+
+	// worker thread: runs jobs while there are any, sleeps otherwise
+	void work(int q) {
+		Tracer::nameThread("job worker");
+		Job job;
+		while (true) {
+			if (take(q, job)) {
+				execute(job, q);
+				continue;
+			}
+			unique_lock<mutex> lock(sleepLock);
+			wake.wait(lock, [&] { return queued > 0 || stopping; });
+			if (stopping)
+				return;
+		}
+	}
+};
+
+// Renderer which rasterizes the quads on the processor into an RGBA buffer laid out like the
+// pixels of an sf::Image, with no graphics card involved. The frame is cut into tiles, every
+// triangle is sorted into the tiles it touches, and the tiles are filled in parallel, each one
+// drawing its triangles in their original order. The result depends on nothing but the draw
+// calls, so a frame gives the same pixels on any number of threads, and no driver is involved.
+class SoftwareRenderer : public Renderer {
+private:
+	// pixels of a texture, read back from it the first time it is drawn with
+	class Source {
+	public:
+		const sf::Texture* texture;
+		sf::Image image;
+		bool smooth;
+		bool repeated;
+		bool stale;  // the texture may have changed since, it is read again in finish
+	};
+
+	// triangle in pixel coordinates, only drawn inside its clip rectangle
+	class Triangle {
+	public:
+		sf::Vertex v[3];
+		int source;  // -1 for plain colors
+		int clip[4]; // left, top, right, bottom, the right and bottom edges excluded
+	};
+
+	static const int tileSize = 64;
+	int width;
+	int height;
+	vector<sf::Uint8> pixels;
+	JobSystem* jobs;
+	const sf::Text* text;       // font settings of the texts
+	vector<Source> sources;
+	vector<Triangle> triangles;
+	vector<vector<int> > tiles; // triangles touching each tile, in drawing order
+	sf::Color background;
+	sf::Transform projection;   // from the view to the pixels
+	int clip[4];                // viewport of the view in pixels
+
+public:
+	// constructor for the SoftwareRenderer class, jobs may be null to render on this thread
+	SoftwareRenderer(int width, int height, JobSystem* jobs, const sf::Text* text) {
+		this->width = width;
+		this->height = height;
+		this->jobs = jobs;
+		this->text = text;
+		pixels.resize(width * height * 4);
+		tiles.resize(((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize));
+	}
+
+	// starts a frame filled with the color
+	void clear(sf::Color color) {
+		background = color;
+		triangles.clear();
+		setView(sf::View(sf::FloatRect(0, 0, (float)width, (float)height)));
+	}
+
+	// the following quads go through the view
+	void setView(const sf::View& view) {
+		// the view maps onto -1..1 with y upwards, which the viewport stretches over its pixels
+		sf::FloatRect viewport = view.getViewport();
+		float left = viewport.left * width;
+		float top = viewport.top * height;
+		float w = viewport.width * width;
+		float h = viewport.height * height;
+		projection = sf::Transform::Identity;
+		projection.translate(left + w / 2, top + h / 2);
+		projection.scale(w / 2, -h / 2);
+		projection.combine(view.getTransform());
+		clip[0] = (int)(left + 0.5f);
+		clip[1] = (int)(top + 0.5f);
+		clip[2] = (int)(left + w + 0.5f);
+		clip[3] = (int)(top + h + 0.5f);
+	}
+
+	// draws quads of four vertices each, split into two triangles
+	void drawQuads(const sf::Vertex* vertices, size_t count, const sf::Texture* texture) {
+		int source = texture ? findSource(texture) : -1;
+		for (size_t q = 0; q + 3 < count; q += 4) {
+			sf::Vertex corners[4];
+			for (int k = 0; k < 4; k++) {
+				corners[k] = vertices[q + k];
+				corners[k].position = projection.transformPoint(vertices[q + k].position);
+			}
+			addTriangle(corners[0], corners[1], corners[2], source);
+			addTriangle(corners[0], corners[2], corners[3], source);
+		}
+	}
+
+	// draws a line of text at a position of the frame, laid out the way sf::Text does it
+	void drawText(const char* str, sf::Vector2f pos) {
+		const sf::Font* font = text->getFont();
+		if (!font)
+			return;
+		unsigned int size = text->getCharacterSize();
+		sf::Color color = text->getFillColor();
+		float x = 0;
+		float y = (float)size;
+		float whitespace = font->getGlyph(' ', size, false).advance;
+		sf::Uint32 previous = 0;
+		vector<sf::Vertex> quads;
+		for (const char* c = str; *c; c++) {
+			sf::Uint32 code = (unsigned char)*c;
+			x += font->getKerning(previous, code, size);
+			previous = code;
+			if (code == ' ' || code == '\t' || code == '\n') {
+				if (code == ' ')
+					x += whitespace;
+				if (code == '\t')
+					x += whitespace * 4;
+				if (code == '\n') {
+					y += font->getLineSpacing(size);
+					x = 0;
+				}
+				continue;
+			}
+
+			// like sf::Text, the glyph gets a pixel of padding on every side
+			const sf::Glyph& glyph = font->getGlyph(code, size, false);
+			float left = pos.x + x + glyph.bounds.left - 1;
+			float top = pos.y + y + glyph.bounds.top - 1;
+			float right = pos.x + x + glyph.bounds.left + glyph.bounds.width + 1;
+			float bottom = pos.y + y + glyph.bounds.top + glyph.bounds.height + 1;
+			float u1 = glyph.textureRect.left - 1.0f;
+			float v1 = glyph.textureRect.top - 1.0f;
+			float u2 = glyph.textureRect.left + glyph.textureRect.width + 1.0f;
+			float v2 = glyph.textureRect.top + glyph.textureRect.height + 1.0f;
+			quads.push_back(sf::Vertex(sf::Vector2f(left, top), color, sf::Vector2f(u1, v1)));
+			quads.push_back(sf::Vertex(sf::Vector2f(right, top), color, sf::Vector2f(u2, v1)));
+			quads.push_back(sf::Vertex(sf::Vector2f(right, bottom), color, sf::Vector2f(u2, v2)));
+			quads.push_back(sf::Vertex(sf::Vector2f(left, bottom), color, sf::Vector2f(u1, v2)));
+			x += glyph.advance;
+		}
+		if (quads.empty())
+			return;
+
+		// loading the glyphs may have added them to the font's texture, so it is read again
+		// before the frame is rasterized, once however many lines used it
+		const sf::Texture* texture = &font->getTexture(size);
+		int source = findSource(texture);
+		sources[source].stale = true;
+		int saved[4] = { clip[0], clip[1], clip[2], clip[3] };
+		clip[0] = 0;
+		clip[1] = 0;
+		clip[2] = width;
+		clip[3] = height;
+		for (size_t q = 0; q < quads.size(); q += 4) {
+			addTriangle(quads[q], quads[q + 1], quads[q + 2], source);
+			addTriangle(quads[q], quads[q + 2], quads[q + 3], source);
+		}
+		for (int k = 0; k < 4; k++)
+			clip[k] = saved[k];
+	}
+
+	// rasterizes the frame
+	void finish() {
+		for (size_t i = 0; i < sources.size(); i++) {
+			if (sources[i].stale) {
+				sources[i].image = sources[i].texture->copyToImage();
+				sources[i].stale = false;
+			}
+		}
+
+		int columns = (width + tileSize - 1) / tileSize;
+		for (size_t t = 0; t < tiles.size(); t++)
+			tiles[t].clear();
+
+		// sort the triangles into the tiles their bounding boxes overlap
+		for (size_t i = 0; i < triangles.size(); i++) {
+			int box[4];
+			if (!bounds(triangles[i], box))
+				continue;
+			for (int ty = box[1] / tileSize; ty <= (box[3] - 1) / tileSize; ty++)
+				for (int tx = box[0] / tileSize; tx <= (box[2] - 1) / tileSize; tx++)
+					tiles[ty * columns + tx].push_back((int)i);
+		}
+
+		JobSystem::parallelFor(jobs, (int)tiles.size(), 1, [&](int begin, int end) {
+			for (int t = begin; t < end; t++)
+				drawTile(t % columns * tileSize, t / columns * tileSize, tiles[t]);
+		});
+	}
+
+	// gives the pixels of a texture, which are then not read back from it; this way textures
+	// which never went to the graphics card can be drawn too
+	void setPixels(const sf::Texture* texture, const sf::Image& image, bool smooth, bool repeated) {
+		Source s;
+		s.texture = texture;
+		s.image = image;
+		s.smooth = smooth;
+		s.repeated = repeated;
+		s.stale = false;
+		sources.push_back(s);
+	}
+
+	// returns the pixels of the last frame, four bytes each, as sf::Image::create takes them
+	const sf::Uint8* getPixels() {
+		return &pixels[0];
+	}
+
+	// returns the last frame as an image
+	sf::Image getImage() {
+		sf::Image image;
+		image.create(width, height, &pixels[0]);
+		return image;
+	}
+
+private:
+	// returns the index of the pixels of a texture, reading them on first use
+	int findSource(const sf::Texture* texture) {
+		for (size_t i = 0; i < sources.size(); i++)
+			if (sources[i].texture == texture)
+				return (int)i;
+		Source s;
+		s.texture = texture;
+		s.image = texture->copyToImage();
+		s.smooth = texture->isSmooth();
+		s.repeated = texture->isRepeated();
+		s.stale = false;
+		sources.push_back(s);
+		return (int)sources.size() - 1;
+	}
+
+	// adds a triangle in pixel coordinates, clipped to the current view
+	void addTriangle(const sf::Vertex& a, const sf::Vertex& b, const sf::Vertex& c, int source) {
+		Triangle t;
+		t.v[0] = a;
+		t.v[1] = b;
+		t.v[2] = c;
+		t.source = source;
+		for (int k = 0; k < 4; k++)
+			t.clip[k] = clip[k];
+		triangles.push_back(t);
+	}
+
+	// computes the pixels a triangle may cover, returns false if there are none
+	bool bounds(const Triangle& t, int* box) {
+		float minX = fmin(t.v[0].position.x, fmin(t.v[1].position.x, t.v[2].position.x));
+		float minY = fmin(t.v[0].position.y, fmin(t.v[1].position.y, t.v[2].position.y));
+		float maxX = fmax(t.v[0].position.x, fmax(t.v[1].position.x, t.v[2].position.x));
+		float maxY = fmax(t.v[0].position.y, fmax(t.v[1].position.y, t.v[2].position.y));
+		box[0] = max(t.clip[0], max(0, (int)floor(minX)));
+		box[1] = max(t.clip[1], max(0, (int)floor(minY)));
+		box[2] = min(t.clip[2], min(width, (int)ceil(maxX) + 1));
+		box[3] = min(t.clip[3], min(height, (int)ceil(maxY) + 1));
+		return box[0] < box[2] && box[1] < box[3];
+	}
+
+	// returns the distance-like value telling on which side of the edge from a to b the point lies
+	static float edge(sf::Vector2f a, sf::Vector2f b, float x, float y) {
+		return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+	}
+
+	// returns true if a point exactly on the edge from a to b belongs to the triangle; of two
+	// triangles sharing an edge exactly one owns it, so the seam of a quad is not blended twice
+	static bool ownsEdge(sf::Vector2f a, sf::Vector2f b) {
+		return b.y - a.y > 0 || (b.y == a.y && b.x < a.x);
+	}
+
+	// draws the triangles of the tile at (left, top)
+	void drawTile(int left, int top, const vector<int>& list) {
+		int right = min(left + tileSize, width);
+		int bottom = min(top + tileSize, height);
+		for (int y = top; y < bottom; y++) {
+			sf::Uint8* p = &pixels[(y * width + left) * 4];
+			for (int x = left; x < right; x++, p += 4) {
+				p[0] = background.r;
+				p[1] = background.g;
+				p[2] = background.b;
+				p[3] = background.a;
+			}
+		}
+
+		for (size_t i = 0; i < list.size(); i++) {
+			const Triangle& t = triangles[list[i]];
+			sf::Vector2f a = t.v[0].position;
+			sf::Vector2f b = t.v[1].position;
+			sf::Vector2f c = t.v[2].position;
+			int order[3] = { 0, 1, 2 };
+			float area = edge(a, b, c.x, c.y);
+			if (area == 0)
+				continue;
+			// turn every triangle the same way round, then the inside is where all edges are positive
+			if (area < 0) {
+				swap(b, c);
+				swap(order[1], order[2]);
+				area = -area;
+			}
+			bool own0 = ownsEdge(b, c);
+			bool own1 = ownsEdge(c, a);
+			bool own2 = ownsEdge(a, b);
+			const sf::Vertex& va = t.v[order[0]];
+			const sf::Vertex& vb = t.v[order[1]];
+			const sf::Vertex& vc = t.v[order[2]];
+			const Source* source = t.source >= 0 ? &sources[t.source] : nullptr;
+
+			int box[4];
+			bounds(t, box);
+			int x0 = max(box[0], left), y0 = max(box[1], top);
+			int x1 = min(box[2], right), y1 = min(box[3], bottom);
+			for (int y = y0; y < y1; y++) {
+				for (int x = x0; x < x1; x++) {
+					// the pixel is covered when its center is inside
+					float px = x + 0.5f, py = y + 0.5f;
+					float w0 = edge(b, c, px, py);
+					float w1 = edge(c, a, px, py);
+					float w2 = edge(a, b, px, py);
+					if (w0 < 0 || w1 < 0 || w2 < 0 || (w0 == 0 && !own0) || (w1 == 0 && !own1) || (w2 == 0 && !own2))
+						continue;
+					w0 /= area;
+					w1 /= area;
+					w2 /= area;
+
+					sf::Color color(
+						(sf::Uint8)(va.color.r * w0 + vb.color.r * w1 + vc.color.r * w2 + 0.5f),
+						(sf::Uint8)(va.color.g * w0 + vb.color.g * w1 + vc.color.g * w2 + 0.5f),
+						(sf::Uint8)(va.color.b * w0 + vb.color.b * w1 + vc.color.b * w2 + 0.5f),
+						(sf::Uint8)(va.color.a * w0 + vb.color.a * w1 + vc.color.a * w2 + 0.5f));
+					if (source) {
+						float u = va.texCoords.x * w0 + vb.texCoords.x * w1 + vc.texCoords.x * w2;
+						float v = va.texCoords.y * w0 + vb.texCoords.y * w1 + vc.texCoords.y * w2;
+						color = color * sample(*source, u, v);
+					}
+					blend(&pixels[(y * width + x) * 4], color);
+				}
+			}
+		}
+	}
+
+	// returns the texel at the texture coordinates, filtered between the four nearest ones if
+	// the texture is smooth
+	static sf::Color sample(const Source& s, float u, float v) {
+		if (!s.smooth)
+			return texel(s, (int)floor(u), (int)floor(v));
+		float fu = u - 0.5f, fv = v - 0.5f;
+		int x = (int)floor(fu), y = (int)floor(fv);
+		int wx = (int)((fu - x) * 256), wy = (int)((fv - y) * 256);
+		sf::Color c00 = texel(s, x, y), c10 = texel(s, x + 1, y);
+		sf::Color c01 = texel(s, x, y + 1), c11 = texel(s, x + 1, y + 1);
+		int k00 = (256 - wx) * (256 - wy), k10 = wx * (256 - wy), k01 = (256 - wx) * wy, k11 = wx * wy;
+		return sf::Color(
+			(sf::Uint8)((c00.r * k00 + c10.r * k10 + c01.r * k01 + c11.r * k11 + 32768) >> 16),
+			(sf::Uint8)((c00.g * k00 + c10.g * k10 + c01.g * k01 + c11.g * k11 + 32768) >> 16),
+			(sf::Uint8)((c00.b * k00 + c10.b * k10 + c01.b * k01 + c11.b * k11 + 32768) >> 16),
+			(sf::Uint8)((c00.a * k00 + c10.a * k10 + c01.a * k01 + c11.a * k11 + 32768) >> 16));
+	}
+
+	// returns a texel, wrapping around for repeated textures and clamped to the edge otherwise
+	static sf::Color texel(const Source& s, int x, int y) {
+		int w = (int)s.image.getSize().x;
+		int h = (int)s.image.getSize().y;
+		if (w == 0 || h == 0)
+			return sf::Color::Transparent;
+		if (s.repeated) {
+			x = ((x % w) + w) % w;
+			y = ((y % h) + h) % h;
+		}
+		else {
+			x = x < 0 ? 0 : (x >= w ? w - 1 : x);
+			y = y < 0 ? 0 : (y >= h ? h - 1 : y);
+		}
+		const sf::Uint8* p = s.image.getPixelsPtr() + (y * w + x) * 4;
+		return sf::Color(p[0], p[1], p[2], p[3]);
+	}
+
+	// blends a color over a pixel the way SFML's default alpha blending does
+	static void blend(sf::Uint8* p, sf::Color c) {
+		int a = c.a;
+		p[0] = (sf::Uint8)((c.r * a + p[0] * (255 - a) + 127) / 255);
+		p[1] = (sf::Uint8)((c.g * a + p[1] * (255 - a) + 127) / 255);
+		p[2] = (sf::Uint8)((c.b * a + p[2] * (255 - a) + 127) / 255);
+		p[3] = (sf::Uint8)((a * 255 + p[3] * (255 - a) + 127) / 255);
+	}
+};
+
+// Writes the frames a game draws into a capture file, see CaptureHeader. Every texture is read
+// back from the graphics card and written once, before the first frame drawing with it, so that
+// the capture can be replayed on its own.
+class DrawRecorder {
+private:
+	ofstream file;
+	map<const sf::Texture*, int> ids; // capture ids of the textures written so far
+	int frames;
+
+public:
+	// constructor for the DrawRecorder class, check isOpen afterwards
+	DrawRecorder(string path, unsigned int width, unsigned int height) : file(path.c_str(), ios::binary) {
+		frames = 0;
+		CaptureHeader h;
+		memcpy(h.magic, "BDRW", 4);
+		h.version = 1;
+		h.width = width;
+		h.height = height;
+		file.write((const char*)&h, sizeof(h));
+	}
+
+	// returns true if the file could be written
+	bool isOpen() {
+		return (bool)file;
+	}
+
+	// appends a frame, with the textures it needs which are not in the file yet
+	void record(DrawList& list) {
+		list.forEachTexture([&](const sf::Texture* texture) {
+			if (ids.count(texture))
+				return;
+			int id = (int)ids.size();
+			ids[texture] = id;
+			sf::Image image = texture->copyToImage();
+			CaptureRecord r = { CaptureRecord::TextureRecord };
+			CaptureTexture t = { (unsigned int)id, image.getSize().x, image.getSize().y, texture->isSmooth(), texture->isRepeated() };
+			file.write((const char*)&r, sizeof(r));
+			file.write((const char*)&t, sizeof(t));
+			if (t.width > 0 && t.height > 0)
+				file.write((const char*)image.getPixelsPtr(), t.width * t.height * 4);
+		});
+		CaptureRecord r = { CaptureRecord::FrameRecord };
+		file.write((const char*)&r, sizeof(r));
+		list.write(file, ids);
+		frames++;
+	}
+
+	// returns the number of frames recorded
+	int getFrames() {
+		return frames;
+	}
+};
+
+// Reads the frames of a capture file back, one draw list at a time
+class DrawPlayer {
+private:
+	ifstream file;
+	CaptureHeader header;
+	vector<const sf::Texture*> textures; // by capture id
+	vector<sf::Image> images;
+	vector<bool> smooth;
+	vector<bool> repeated;
+	bool upload;                         // the textures go to the graphics card
+
+public:
+	// constructor for the DrawPlayer class, check isOpen afterwards
+	// without upload the textures only keep their pixels, for a SoftwareRenderer
+	DrawPlayer(string path, bool upload) : file(path.c_str(), ios::binary) {
+		this->upload = upload;
+		if (!file.read((char*)&header, sizeof(header)) || memcmp(header.magic, "BDRW", 4) != 0 || header.version != 1)
+			file.setstate(ios::failbit);
+	}
+
+	// destructor for the DrawPlayer class
+	~DrawPlayer() {
+		for (size_t i = 0; i < textures.size(); i++)
+			delete textures[i];
+	}
+
+	// returns true if the file is a capture
+	bool isOpen() {
+		return (bool)file;
+	}
+
+	// returns the size of the window the frames were drawn into
+	sf::Vector2u getSize() {
+		return sf::Vector2u(header.width, header.height);
+	}
+
+	// reads the next frame into the list, returns false at the end of the file or on an error
+	bool next(DrawList& list) {
+		CaptureRecord r;
+		while (file.read((char*)&r, sizeof(r))) {
+			if (r.kind == CaptureRecord::FrameRecord)
+				return list.read(file, textures);
+			CaptureTexture t;
+			if (r.kind != CaptureRecord::TextureRecord || !file.read((char*)&t, sizeof(t)) || t.id != textures.size()
+				|| t.width > 16384 || t.height > 16384)
+				return false;
+			vector<sf::Uint8> pixels(t.width * t.height * 4);
+			if (!pixels.empty() && !file.read((char*)&pixels[0], pixels.size()))
+				return false;
+
+			sf::Image image;
+			if (!pixels.empty())
+				image.create(t.width, t.height, &pixels[0]);
+			sf::Texture* texture = new sf::Texture;
+			if (upload) {
+				texture->loadFromImage(image);
+				texture->setSmooth(t.smooth != 0);
+				texture->setRepeated(t.repeated != 0);
+			}
+			textures.push_back(texture);
+			images.push_back(image);
+			smooth.push_back(t.smooth != 0);
+			repeated.push_back(t.repeated != 0);
+		}
+		return false;
+	}
+
+	// hands the pixels of the textures read so far to a software renderer
+	void addPixels(SoftwareRenderer& renderer, size_t from) {
+		for (size_t i = from; i < textures.size(); i++)
+			renderer.setPixels(textures[i], images[i], smooth[i], repeated[i]);
+	}
+
+	// returns the number of textures read so far
+	size_t getNumTextures() {
+		return textures.size();
+	}
+
+	// replays every frame of a capture, in a window or with the software renderer, and prints
+	// how long the frames took to draw; returns false if the capture can not be read
+	static bool benchmark(string path, bool software, JobSystem* jobs) {
+		DrawPlayer player(path, !software);
+		if (!player.isOpen()) {
+			cerr << path << " is not a draw capture" << endl;
+			return false;
+		}
+		sf::Vector2u size = player.getSize();
+		sf::RenderWindow* window = nullptr;
+		sf::Font font;
+		sf::Text text;
+		Renderer* renderer;
+		if (software) {
+			// texts are left out, their glyphs could only be made on the graphics card
+			renderer = new SoftwareRenderer(size.x, size.y, jobs, &text);
+		}
+		else {
+			window = new sf::RenderWindow(sf::VideoMode(size.x, size.y), "Replay");
+			AssetBundle::instance().loadFont("font.ttf", font);
+			text.setFont(font);
+			renderer = new WindowRenderer(window, &text);
+		}
+
+		DrawList list;
+		int frames = 0;
+		double total = 0;
+		double worst = 0;
+		size_t known = 0;
+		while (player.next(list)) {
+			if (software) {
+				player.addPixels(*(SoftwareRenderer*)renderer, known);
+				known = player.getNumTextures();
+			}
+			auto start = chrono::steady_clock::now();
+			list.replay(*renderer);
+			if (window)
+				window->display();
+			double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			total += ms;
+			if (ms > worst)
+				worst = ms;
+			frames++;
+		}
+		cout << frames << " frames " << (software ? "in software" : "in the window") << ": average "
+			<< (frames > 0 ? total / frames : 0) << " ms, worst " << worst << " ms per frame" << endl;
+		delete renderer;
+		delete window;
+		return true;
+	}
+};
+
+// Object base class
+class Object {
+private:
+	DrawList* drawList;
+	sf::Sprite sprite;
+	Coord pos;
+
+public:
+	// initializes the object, originY is the height of its center point relative to the texture
+	void init(DrawList* drawList, string texturePath, Coord pos, float originY = 0.5f) {
+		this->drawList = drawList;
+
+		// load the object texture (headless games draw nothing and need no textures)
+		if (!texturePath.empty() && drawList)
+			sprite.setTexture(*TextureCache::instance().get(texturePath));
+
+		if (sprite.getTexture()) {
+			// define the center point for the object
+			sf::Vector2u size = TextureCache::instance().getSize(*sprite.getTexture());
+			float x = size.x * 0.5f;
+			float y = size.y * originY;
+			sprite.setOrigin(x, y);
+		}
+
+		this->pos = pos;
+	}
+
+	// changes the sprite's texture, the first one gives the sprite its size
+	void setTexture(const sf::Texture& texture) {
+		sprite.setTexture(texture);
+		// a texture which only has its pixels looks empty to the sprite
+		if (sprite.getTextureRect() == sf::IntRect()) {
+			sf::Vector2u size = TextureCache::instance().getSize(texture);
+			sprite.setTextureRect(sf::IntRect(0, 0, (int)size.x, (int)size.y));
+		}
+	}
+
+	// returns the sprite's texture
+	const sf::Texture* getTexture() {
+		return sprite.getTexture();
+	}
+
+	// changes the object's position
+	void setPosition(float x, float y) {
+		pos.x = x;
+		pos.y = y;
+	}
+
+	// returns the object's position
+	Coord getPosition() {
+		return pos;
+	}
+
+	// moves the object by a given offset
+	void move(float offsetX, float offsetY) {
+		pos.x += offsetX;
+		pos.y += offsetY;
+	}
+
+	// changes the object's angle
+	void setAngle(float radians) {
+		// convert radians to degrees
+		float degrees = radians / pi * 180;
+		sprite.setRotation(degrees);
+	}
+
+	// draws the object's sprite
+	void paint() {
+		sprite.setPosition(pos.x, pos.y);
+		drawList->draw(sprite);
+	}
+
+	// checks whether object collides with another object
+	bool collideObject(Object& other) {
+		// distance-based check
+		float dx = pos.x - other.pos.x;
+		float dy = pos.y - other.pos.y;
+		float distance = sqrt(dx * dx + dy * dy);
+		return distance < 30;
+	}
+
+	// checks whether the object is inside the world of the given size
+	bool insideWindow(float border, float width, float height) {
+		if (pos.x < border || pos.x > width - border)
+			return false;
+		if (pos.y < border || pos.y > height - border)
+			return false;
+		return true;
+	}
+};
+
+// Entity handle, the index of the entity's slot in the component arrays of the World
+typedef int Entity;
+
+// Position of an entity and the rotation its sprite is drawn with
+class Transform {
+public:
+	float x;
+	float y;
+	float rotation; // radians
+};
+
+// Distance an entity moves in every frame
+class Velocity {
+public:
+	float x;
+	float y;
+};
+
+// Texture an entity is drawn with, the origin is the entity's position on the texture
+class Sprite {
+public:
+	const sf::Texture* texture; // none in headless games
+	float originX;
+	float originY;
+	int frame;                  // for entities drawn from a SpriteAtlas, or the frame of a strip
+	int numFrames;              // frames side by side on the texture, 0 or 1 for a plain texture
+};
+
+// Collision shape of an entity, two entities collide when their distance is below the sum of their radii
+class Collider {
+public:
+	float radius;
+	int owner;  // player who fired a bullet, -1 for everything else
+};
+
+// Hit points of an entity, an entity which is not visible is neither drawn nor hit
+class Health {
+public:
+	int hp;
+	bool visible;
+};
+
+// Storage of the entities of a game. Every component kind is kept in its own dense array indexed
+// by the entity, and a mask per entity tells which of the components it has. A new kind of entity
+// is just a new combination of components, and the systems below run over the arrays in order.
+class World {
+public:
+	enum ComponentBit { TransformBit = 1, VelocityBit = 2, SpriteBit = 4, ColliderBit = 8, HealthBit = 16 };
+
+private:
+	DrawList* drawList;
+	vector<unsigned int> masks; // 0 for a free slot
+	vector<Transform> transforms;
+	vector<Velocity> velocities;
+	vector<Sprite> sprites;
+	vector<Collider> colliders;
+	vector<Health> healths;
+	vector<Entity> freeSlots;   // slots of destroyed entities, reused before the arrays grow
+	sf::Sprite brush;           // used to draw every entity
+
+public:
+	// constructor for the World class
+	World(DrawList* drawList) {
+		this->drawList = drawList;
+	}
+
+	// creates an entity with the given components, all set to zero
+	Entity create(unsigned int mask) {
+		Entity e;
+		if (!freeSlots.empty()) {
+			e = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else {
+			e = (Entity)masks.size();
+			masks.push_back(0);
+			transforms.push_back(Transform());
+			velocities.push_back(Velocity());
+			sprites.push_back(Sprite());
+			colliders.push_back(Collider());
+			healths.push_back(Health());
+		}
+
+		masks[e] = mask;
+		transforms[e] = Transform();
+		velocities[e] = Velocity();
+		sprites[e] = Sprite();
+		colliders[e].radius = 0;
+		colliders[e].owner = -1;
+		healths[e].hp = 1;
+		healths[e].visible = true;
+		return e;
+	}
+
+	// destroys an entity, its slot is reused by the next one created
+	void destroy(Entity e) {
+		masks[e] = 0;
+		freeSlots.push_back(e);
+	}
+
+	// destroys every entity from the slot size on and forgets the free slots, so that the next
+	// entities get the same slots as in a world which only ever had the first size entities
+	// the arrays keep their memory
+	void reset(int size) {
+		masks.resize(size);
+		transforms.resize(size);
+		velocities.resize(size);
+		sprites.resize(size);
+		colliders.resize(size);
+		healths.resize(size);
+		freeSlots.clear();
+	}
+
+	// returns the number of slots, entities are below it
+	int getSize() {
+		return (int)masks.size();
+	}
+
+	// returns true if the entity has all of the components
+	bool has(Entity e, unsigned int mask) {
+		return (masks[e] & mask) == mask;
+	}
+
+	// returns the transform of an entity
+	Transform& transform(Entity e) {
+		return transforms[e];
+	}
+
+	// returns the velocity of an entity
+	Velocity& velocity(Entity e) {
+		return velocities[e];
+	}
+
+	// returns the sprite of an entity
+	Sprite& sprite(Entity e) {
+		return sprites[e];
+	}
+
+	// returns the collider of an entity
+	Collider& collider(Entity e) {
+		return colliders[e];
+	}
+
+	// returns the health of an entity
+	Health& health(Entity e) {
+		return healths[e];
+	}
+
+	// returns the position of an entity
+	Coord getPosition(Entity e) {
+		return Coord(transforms[e].x, transforms[e].y);
+	}
+
+	// sets the texture of an entity, originY is the height of its center point relative to the texture
+	// with damage states, the texture is a strip of frames from TextureCache::getDamaged
+	void setSprite(Entity e, string texturePath, float originY = 0.5f, int damageStates = 1) {
+		// headless games draw nothing and need no textures
+		Sprite& s = sprites[e];
+		if (!drawList)
+			s.texture = nullptr;
+		else if (damageStates > 1)
+			s.texture = TextureCache::instance().getDamaged(texturePath, damageStates);
+		else s.texture = TextureCache::instance().get(texturePath);
+		s.frame = 0;
+		s.numFrames = damageStates;
+		if (s.texture) {
+			sf::Vector2u size = TextureCache::instance().getSize(*s.texture);
+			s.originX = size.x / damageStates * 0.5f;
+			s.originY = size.y * originY;
+		}
+	}
+
+	// returns true if the entity collides with something of the given radius at the position
+	bool collides(Entity e, Coord pos, float radius) {
+		float dx = transforms[e].x - pos.x;
+		float dy = transforms[e].y - pos.y;
+		float reach = colliders[e].radius + radius;
+		return dx * dx + dy * dy < reach * reach;
+	}
+
+	// movement system: moves the given entities by their velocity, they all have to have one
+	void move(const vector<Entity>& entities, JobSystem* jobs) {
+		JobSystem::parallelFor(jobs, (int)entities.size(), 1024, [&](int begin, int end) {
+			for (int k = begin; k < end; k++) {
+				Entity e = entities[k];
+				transforms[e].x += velocities[e].x;
+				transforms[e].y += velocities[e].y;
+			}
+		});
+	}
+
+	// render system: draws an entity with its sprite, unless it is hidden
+	void paint(Entity e) {
+		const Sprite& s = sprites[e];
+		if (!s.texture || (has(e, HealthBit) && !healths[e].visible))
+			return;
+		sf::Vector2u size = TextureCache::instance().getSize(*s.texture);
+		int w = (int)size.x / s.numFrames;
+		brush.setTexture(*s.texture);
+		brush.setTextureRect(sf::IntRect(s.frame * w, 0, w, (int)size.y));
+		brush.setOrigin(s.originX, s.originY);
+		brush.setRotation(transforms[e].rotation / pi * 180);
+		brush.setPosition(transforms[e].x, transforms[e].y);
+		drawList->draw(brush);
+	}
+};
+
+// Uniform grid which buckets objects by position, so that nearby objects are found without
+// looking at all of them. Obstacles never move, so the buckets are built once in two flat arrays.
+class SpatialGrid {
+private:
+	float cellSize;
+	int cols;
+	int rows;
+	int* cellStart; // objects of cell c are items[cellStart[c]] up to items[cellStart[c + 1]]
+	int* items;
+
+public:
+	// constructor for the SpatialGrid class
+	SpatialGrid() {
+		cellSize = 1;
+		cols = 0;
+		rows = 0;
+		cellStart = nullptr;
+		items = nullptr;
+	}
+
+	// destructor for the SpatialGrid class
+	~SpatialGrid() {
+		delete[] cellStart;
+		delete[] items;
+	}
+
+	// buckets n objects by their position, positionOf(i) returns the position of object i
+	template <class F>
+	void build(float width, float height, float cellSize, int n, F positionOf) {
+		this->cellSize = cellSize;
+		cols = (int)(width / cellSize) + 1;
+		rows = (int)(height / cellSize) + 1;
+		delete[] cellStart;
+		delete[] items;
+		cellStart = new int[cols * rows + 1];
+		items = new int[n > 0 ? n : 1];
+
+		// count the objects per cell, turn the counts into offsets, then fill the cells
+		for (int c = 0; c <= cols * rows; c++)
+			cellStart[c] = 0;
+		for (int i = 0; i < n; i++)
+			cellStart[cellOf(positionOf(i)) + 1]++;
+		for (int c = 0; c < cols * rows; c++)
+			cellStart[c + 1] += cellStart[c];
+		int* fill = new int[cols * rows];
+		for (int c = 0; c < cols * rows; c++)
+			fill[c] = cellStart[c];
+		for (int i = 0; i < n; i++)
+			items[fill[cellOf(positionOf(i))]++] = i;
+		delete[] fill;
+	}
+
+	// calls visit(index) for every object in the cells overlapping the rectangle
+	template <class F>
+	void query(float left, float top, float right, float bottom, F visit) {
+		int c0 = clamp((int)floor(left / cellSize), cols);
+		int c1 = clamp((int)floor(right / cellSize), cols);
+		int r0 = clamp((int)floor(top / cellSize), rows);
+		int r1 = clamp((int)floor(bottom / cellSize), rows);
+		for (int r = r0; r <= r1; r++)
+			for (int c = c0; c <= c1; c++)
+				for (int k = cellStart[r * cols + c]; k < cellStart[r * cols + c + 1]; k++)
+					visit(items[k]);
+	}
+
+private:
+	// keeps a cell coordinate inside the grid
+	int clamp(int v, int n) {
+		return v < 0 ? 0 : (v >= n ? n - 1 : v);
+	}
+
+	// returns the cell which contains the position
+	int cellOf(Coord pos) {
+		return clamp((int)floor(pos.y / cellSize), rows) * cols + clamp((int)floor(pos.x / cellSize), cols);
+	}
+};
+
+// Sandbags and barrels of the level. The game only talks to them through this interface,
+// so they may either live in memory or be streamed from a world file.
+class Obstacles {
+private:
+	vector<int> changed; // barrels which were hidden or shown since the last clearChanges
+
+public:
+	// destructor for the Obstacles class
+	virtual ~Obstacles() {}
+
+	// returns the number of barrels
+	virtual int getNumBarrels() = 0;
+
+	// returns the number of sandbags
+	virtual int getNumSandbags() = 0;
+
+	// returns the position of a barrel
+	virtual Coord getBarrelPosition(int i) = 0;
+
+	// returns the position of a sandbag
+	virtual Coord getSandbagPosition(int i) = 0;
+
+	// returns true if the barrel was not destroyed
+	virtual bool isBarrelVisible(int i) = 0;
+
+	// shows how damaged a barrel is, from 0 for intact up to numDamageStates - 1
+	virtual void setBarrelDamage(int i, int state) = 0;
+
+	// returns true if an object at the position collides with a sandbag
+	virtual bool hitSandbag(Coord pos) = 0;
+
+	// returns the index of a visible barrel an object at the position collides with, or -1
+	virtual int hitBarrel(Coord pos) = 0;
+
+	// returns true if a bullet flying from a to b would be stopped by a sandbag
+	virtual bool sandbagBetween(Coord a, Coord b) = 0;
+
+	// draws the obstacles inside the rectangle
+	virtual void paint(sf::FloatRect area) = 0;
+
+	// adds the positions of the sandbags and visible barrels inside the rectangle to positions,
+	// along with some of those close to it
+	virtual void findObstacles(float left, float top, float right, float bottom, vector<Coord>& positions) = 0;
+
+	// returns true if an object at the position collides with a sandbag or a visible barrel
+	bool collides(Coord pos) {
+		return hitSandbag(pos) || hitBarrel(pos) >= 0;
+	}
+
+	// hides a barrel which was destroyed
+	void hideBarrel(int i) {
+		if (isBarrelVisible(i)) {
+			setBarrelVisible(i, false);
+			changed.push_back(i);
+		}
+	}
+
+	// shows a destroyed barrel again
+	void showBarrel(int i) {
+		if (!isBarrelVisible(i)) {
+			setBarrelVisible(i, true);
+			changed.push_back(i);
+		}
+	}
+
+	// shows all barrels again
+	void showBarrels() {
+		for (int i = 0; i < getNumBarrels(); i++)
+			showBarrel(i);
+	}
+
+	// returns the barrels which were hidden or shown since the last clearChanges
+	const vector<int>& getChanges() {
+		return changed;
+	}
+
+	// forgets the changes after everybody has seen them
+	void clearChanges() {
+		changed.clear();
+	}
+
+	// returns true if objects at the two positions collide, like Object::collideObject
+	static bool touches(Coord a, Coord b) {
+		float dx = a.x - b.x;
+		float dy = a.y - b.y;
+		return sqrt(dx * dx + dy * dy) < 30;
+	}
+
+	// looks a barrel can have, the last one just before it is destroyed
+	static const int numDamageStates = 3;
+
+protected:
+	// hides or shows a barrel
+	virtual void setBarrelVisible(int i, bool visible) = 0;
+
+	// returns true if the segment passes within collision distance of the point
+	static bool segmentHits(Coord a, Coord b, Coord p) {
+		float dx = b.x - a.x;
+		float dy = b.y - a.y;
+		float len = dx * dx + dy * dy;
+		float t = len > 0 ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / len : 0;
+		if (t < 0) t = 0;
+		if (t > 1) t = 1;
+		float ex = a.x + t * dx - p.x;
+		float ey = a.y + t * dy - p.y;
+		return ex * ex + ey * ey < 30 * 30;
+	}
+};
+
+// Obstacles kept in memory as entities of the World, each kind bucketed in its own spatial grid
+class ObstacleMap : public Obstacles {
+private:
+	World* world;
+	vector<Entity> barrels;
+	vector<Entity> sandbags;
+	SpatialGrid barrelGrid;
+	SpatialGrid sandbagGrid;
+
+public:
+	// constructor for the ObstacleMap class
+	ObstacleMap(World* world) {
+		this->world = world;
+	}
+
+	// adds a barrel, the center of its texture is higher
+	void addBarrel(Coord pos, string texturePath) {
+		Entity barrel = add(pos, texturePath, 0.3f, World::HealthBit, numDamageStates);
+		barrels.push_back(barrel);
+	}
+
+	// adds a sandbag, the center of its texture is higher
+	void addSandbag(Coord pos, string texturePath) {
+		Entity sandbag = add(pos, texturePath, 0.4f, 0, 1);
+		sandbags.push_back(sandbag);
+	}
+
+	// returns the number of barrels
+	int getNumBarrels() {
+		return (int)barrels.size();
+	}
+
+	// returns the number of sandbags
+	int getNumSandbags() {
+		return (int)sandbags.size();
+	}
+
+	// returns the position of a barrel
+	Coord getBarrelPosition(int i) {
+		return world->getPosition(barrels[i]);
+	}
+
+	// returns the position of a sandbag
+	Coord getSandbagPosition(int i) {
+		return world->getPosition(sandbags[i]);
+	}
+
+	// returns true if the barrel was not destroyed
+	bool isBarrelVisible(int i) {
+		return world->health(barrels[i]).visible;
+	}
+
+	// shows how damaged a barrel is with the frame of its sprite
+	void setBarrelDamage(int i, int state) {
+		world->sprite(barrels[i]).frame = state;
+	}
+
+	// buckets the obstacles once they were all added
+	void buildGrids(float width, float height) {
+		barrelGrid.build(width, height, 128, getNumBarrels(), [&](int i) { return getBarrelPosition(i); });
+		sandbagGrid.build(width, height, 128, getNumSandbags(), [&](int i) { return getSandbagPosition(i); });
+	}
+
+	// returns true if an object at the position collides with a sandbag
+	bool hitSandbag(Coord pos) {
+		bool hit = false;
+		sandbagGrid.query(pos.x - 30, pos.y - 30, pos.x + 30, pos.y + 30, [&](int i) {
+			if (!hit && touches(pos, getSandbagPosition(i)))
+				hit = true;
+		});
+		return hit;
+	}
+
+	// returns the index of a visible barrel an object at the position collides with, or -1
+	int hitBarrel(Coord pos) {
+		int hit = -1;
+		barrelGrid.query(pos.x - 30, pos.y - 30, pos.x + 30, pos.y + 30, [&](int i) {
+			if (hit < 0 && isBarrelVisible(i) && touches(pos, getBarrelPosition(i)))
+				hit = i;
+		});
+		return hit;
+	}
+
+	// returns true if a bullet flying from a to b would be stopped by a sandbag
+	bool sandbagBetween(Coord a, Coord b) {
+		bool hit = false;
+		sandbagGrid.query(fmin(a.x, b.x) - 30, fmin(a.y, b.y) - 30, fmax(a.x, b.x) + 30, fmax(a.y, b.y) + 30, [&](int i) {
+			if (!hit && segmentHits(a, b, getSandbagPosition(i)))
+				hit = true;
+		});
+		return hit;
+	}
+
+	// adds the sandbags and visible barrels in the grid cells overlapping the rectangle
+	void findObstacles(float left, float top, float right, float bottom, vector<Coord>& positions) {
+		sandbagGrid.query(left, top, right, bottom, [&](int i) {
+			positions.push_back(getSandbagPosition(i));
+		});
+		barrelGrid.query(left, top, right, bottom, [&](int i) {
+			if (isBarrelVisible(i))
+				positions.push_back(getBarrelPosition(i));
+		});
+	}
+
+	// draws the obstacles inside the rectangle, the others are not even looked at
+	void paint(sf::FloatRect area) {
+		// sprites reach past their position, so look a bit further than the rectangle
+		float left = area.left - 64;
+		float top = area.top - 64;
+		float right = area.left + area.width + 64;
+		float bottom = area.top + area.height + 64;
+		barrelGrid.query(left, top, right, bottom, [&](int i) {
+			world->paint(barrels[i]);
+		});
+		sandbagGrid.query(left, top, right, bottom, [&](int i) {
+			world->paint(sandbags[i]);
+		});
+	}
+
+protected:
+	// hides or shows a barrel
+	void setBarrelVisible(int i, bool visible) {
+		world->health(barrels[i]).visible = visible;
+	}
+
+private:
+	// creates the entity of an obstacle
+	Entity add(Coord pos, string texturePath, float originY, unsigned int components, int damageStates) {
+		Entity e = world->create(World::TransformBit | World::SpriteBit | World::ColliderBit | components);
+		world->transform(e).x = pos.x;
+		world->transform(e).y = pos.y;
+		world->collider(e).radius = 15;
+		world->setSprite(e, texturePath, originY, damageStates);
+		return e;
+	}
+};
+
+// One bit per square cell of the world, set where a player could touch a sandbag or a visible
+// barrel. A clear bit means nothing can be touched anywhere in the cell, which settles most
+// movement checks with a single lookup; only next to obstacles are they checked exactly.
+class OccupancyMap {
+private:
+	int cols;
+	int rows;
+	float cellSize;
+	vector<unsigned int> bits; // row by row, 32 cells per word
+	vector<Coord> near;        // obstacles around a changed barrel, kept between updates
+
+public:
+	// constructor for the OccupancyMap class
+	OccupancyMap(float width, float height, float cellSize) {
+		this->cellSize = cellSize;
+		cols = (int)ceil(width / cellSize);
+		rows = (int)ceil(height / cellSize);
+		bits.assign((cols * rows + 31) / 32, 0);
+	}
+
+	// marks the cells around every obstacle
+	void build(Obstacles& obstacles) {
+		bits.assign(bits.size(), 0);
+		stamp(obstacles, 0, 0, cols, rows);
+	}
+
+	// follows the barrels which were destroyed or shown again since the last clearChanges
+	void update(Obstacles& obstacles) {
+		const vector<int>& changes = obstacles.getChanges();
+		for (size_t k = 0; k < changes.size(); k++) {
+			// the cells around the barrel are cleared and marked again by the obstacles still reaching
+			// them, which are only looked for around the cells
+			Coord pos = obstacles.getBarrelPosition(changes[k]);
+			int c0 = max(0, (int)floor((pos.x - reach) / cellSize));
+			int r0 = max(0, (int)floor((pos.y - reach) / cellSize));
+			int c1 = min(cols, (int)floor((pos.x + reach) / cellSize) + 1);
+			int r1 = min(rows, (int)floor((pos.y + reach) / cellSize) + 1);
+			for (int r = r0; r < r1; r++)
+				for (int c = c0; c < c1; c++)
+					bits[(r * cols + c) / 32] &= ~(1u << ((r * cols + c) % 32));
+			near.clear();
+			obstacles.findObstacles(c0 * cellSize - reach, r0 * cellSize - reach, c1 * cellSize + reach, r1 * cellSize + reach, near);
+			for (size_t i = 0; i < near.size(); i++)
+				stamp(near[i], c0, r0, c1, r1);
+		}
+	}
+
+	// returns true if a player at the position collides with a sandbag or a visible barrel
+	bool collides(Coord pos, Obstacles& obstacles) {
+		int c = (int)floor(pos.x / cellSize);
+		int r = (int)floor(pos.y / cellSize);
+		if (c >= 0 && c < cols && r >= 0 && r < rows && !(bits[(r * cols + c) / 32] & (1u << ((r * cols + c) % 32))))
+			return false;
+		return obstacles.collides(pos);
+	}
+
+private:
+	static const int reach = 30; // distance within which a player touches an obstacle, see Obstacles::touches
+
+	// marks the cells in columns c0..c1 and rows r0..r1 (excluded) which an obstacle reaches into
+	void stamp(Obstacles& obstacles, int c0, int r0, int c1, int r1) {
+		for (int i = 0; i < obstacles.getNumSandbags(); i++)
+			stamp(obstacles.getSandbagPosition(i), c0, r0, c1, r1);
+		for (int i = 0; i < obstacles.getNumBarrels(); i++)
+			if (obstacles.isBarrelVisible(i))
+				stamp(obstacles.getBarrelPosition(i), c0, r0, c1, r1);
+	}
+
+	// marks the cells in the range which come within reach of an obstacle at the position
+	void stamp(Coord pos, int c0, int r0, int c1, int r1) {
+		c0 = max(c0, (int)floor((pos.x - reach) / cellSize));
+		r0 = max(r0, (int)floor((pos.y - reach) / cellSize));
+		c1 = min(c1, (int)floor((pos.x + reach) / cellSize) + 1);
+		r1 = min(r1, (int)floor((pos.y + reach) / cellSize) + 1);
+		for (int r = r0; r < r1; r++) {
+			for (int c = c0; c < c1; c++) {
+				// distance from the obstacle to the closest point of the cell
+				float dx = fmax(fmax(c * cellSize - pos.x, pos.x - (c + 1) * cellSize), 0.0f);
+				float dy = fmax(fmax(r * cellSize - pos.y, pos.y - (r + 1) * cellSize), 0.0f);
+				if (dx * dx + dy * dy <= reach * reach)
+					bits[(r * cols + c) / 32] |= 1u << ((r * cols + c) % 32);
+			}
+		}
+	}
+};
+
+// Header of a world file, the chunked form of a level for maps too large to keep in memory.
+// The world is cut into square chunks; the file holds, in this order, the header,
+// barrelStart[cols * rows + 1], sandbagStart[cols * rows + 1], the barrel positions and the
+// sandbag positions sorted by chunk, the spawn points and the texture path pool.
+// The barrels of chunk c are barrels[barrelStart[c]] up to barrels[barrelStart[c + 1]].
+class WorldHeader {
+public:
+	char magic[4];             // "BWLD"
+	unsigned int version;
+	unsigned int width;
+	unsigned int height;
+	unsigned int chunkSize;
+	unsigned int cols;
+	unsigned int rows;
+	unsigned int numBarrels;
+	unsigned int numSandbags;
+	unsigned int numSpawns;
+	unsigned int stringBytes;  // size of the texture path pool at the end of the file
+	unsigned int textures[3];  // offsets of the texture paths in the pool, see Level::ObjectType
+
+	// returns the column of the chunk which contains the x coordinate
+	int colOf(float x) const {
+		int c = (int)floor(x / chunkSize);
+		return c < 0 ? 0 : (c >= (int)cols ? cols - 1 : c);
+	}
+
+	// returns the row of the chunk which contains the y coordinate
+	int rowOf(float y) const {
+		int r = (int)floor(y / chunkSize);
+		return r < 0 ? 0 : (r >= (int)rows ? rows - 1 : r);
+	}
+
+	// returns the number of entries of a chunk start array
+	size_t numStarts() const {
+		return (size_t)cols * rows + 1;
+	}
+
+	// returns the number of bytes the file should have
+	size_t fileSize() const {
+		return sizeof(WorldHeader) + 2 * numStarts() * sizeof(unsigned int)
+			+ ((size_t)numBarrels + numSandbags + numSpawns) * sizeof(Coord) + stringBytes;
+	}
+
+	// returns where the barrels of each chunk start, the sections follow the header in the file
+	const unsigned int* barrelStart() const {
+		return (const unsigned int*)(this + 1);
+	}
+
+	// returns where the sandbags of each chunk start
+	const unsigned int* sandbagStart() const {
+		return barrelStart() + numStarts();
+	}
+
+	// returns the barrel positions
+	const Coord* barrels() const {
+		return (const Coord*)(sandbagStart() + numStarts());
+	}
+
+	// returns the sandbag positions
+	const Coord* sandbags() const {
+		return barrels() + numBarrels;
+	}
+
+	// returns the spawn points
+	const Coord* spawns() const {
+		return sandbags() + numSandbags;
+	}
+
+	// returns the texture path pool
+	const char* strings() const {
+		return (const char*)(spawns() + numSpawns);
+	}
+};
+
+// Drawable data of one chunk of the world
+class Chunk {
+public:
+	int index;
+	unsigned int lastUsed;   // paint call which last needed the chunk, the oldest chunk is evicted first
+	sf::VertexArray ground;  // the repeated grass under the chunk
+	sf::VertexArray barrels; // four vertices per barrel of the chunk, in file order
+	sf::VertexArray sandbags;
+};
+
+// A byte for each of very many barrels of which only a few are not 0, such as their damage.
+// Only those few are stored, sorted by barrel, so memory grows with them and not with the map.
+class SparseBytes {
+private:
+	vector<pair<int, unsigned char> > entries;
+
+public:
+	// returns the byte of the barrel
+	unsigned char get(int i) const {
+		size_t k = find(i);
+		return k < entries.size() && entries[k].first == i ? entries[k].second : 0;
+	}
+
+	// sets the byte of the barrel, 0 drops its entry
+	void set(int i, unsigned char value) {
+		size_t k = find(i);
+		bool present = k < entries.size() && entries[k].first == i;
+		if (value == 0) {
+			if (present)
+				entries.erase(entries.begin() + k);
+		}
+		else if (present)
+			entries[k].second = value;
+		else entries.insert(entries.begin() + k, make_pair(i, value));
+	}
+
+	// returns the number of barrels whose byte is not 0
+	int getSize() const {
+		return (int)entries.size();
+	}
+
+	// returns the k-th of those barrels, in increasing order
+	int getBarrel(int k) const {
+		return entries[k].first;
+	}
+
+	// sets every byte back to 0
+	void clear() {
+		entries.clear();
+	}
+
+private:
+	// returns the index of the entry of the barrel, or of the first later one
+	size_t find(int i) const {
+		return lower_bound(entries.begin(), entries.end(), make_pair(i, (unsigned char)0)) - entries.begin();
+	}
+};
+
+// Streams the drawable chunks around the cameras from a world file. A loader thread builds
+// the chunks which come into view, touching their part of the file off the game thread,
+// and only a bounded number of chunks is kept, so memory does not grow with the map.
+class ChunkStreamer {
+private:
+	const WorldHeader* world;
+	const unsigned int* barrelStart;
+	const unsigned int* sandbagStart;
+	const Coord* barrels;
+	const Coord* sandbags;
+	DrawList* drawList;
+	sf::Texture* textures[3];        // see Level::ObjectType
+	sf::Vector2f sizes[2];           // barrel and sandbag texture sizes, read by the loader thread
+	float originY[2];
+	map<int, Chunk*> resident;
+	size_t capacity;
+	unsigned int paints;
+	vector<Chunk*> visible;          // of the current paint, kept so that painting allocates nothing
+	vector<Chunk*> arrived;          // taken from ready, kept likewise
+	vector<pair<unsigned int, int> > ages; // last paint and index of every resident chunk, for evict
+	const vector<bool>* hidden;      // destroyed barrels, applied to the chunks as they arrive
+	const SparseBytes* damage;       // damage states of the barrels, applied the same way
+
+	// shared with the loader thread
+	mutex lock;
+	condition_variable wake;
+	deque<int> requests;
+	set<int> pending;                // requested chunks which did not arrive yet
+	vector<Chunk*> ready;
+	bool stopping;
+	thread loader;
+
+public:
+	// constructor for the ChunkStreamer class
+	// textures are the barrel, sandbag and ground textures, the ground one set to repeat
+	// and the barrel one holding a frame for every damage state, see TextureCache::getDamaged
+	ChunkStreamer(const WorldHeader* world, const vector<bool>* hidden, const SparseBytes* damage, DrawList* drawList, sf::Vector2u screen, sf::Texture* textures[3], float barrelOriginY, float sandbagOriginY) {
+		this->world = world;
+		barrelStart = world->barrelStart();
+		sandbagStart = world->sandbagStart();
+		barrels = world->barrels();
+		sandbags = world->sandbags();
+		this->hidden = hidden;
+		this->damage = damage;
+		this->drawList = drawList;
+		for (int i = 0; i < 3; i++)
+			this->textures[i] = textures[i];
+		for (int i = 0; i < 2; i++)
+			sizes[i] = sf::Vector2f((float)textures[i]->getSize().x, (float)textures[i]->getSize().y);
+		sizes[BarrelTexture].x /= Obstacles::numDamageStates;
+		originY[0] = barrelOriginY;
+		originY[1] = sandbagOriginY;
+
+		// keep enough chunks for both halves of a split screen, with a ring around each
+		capacity = 2 * (screen.x / world->chunkSize + 4) * (screen.y / world->chunkSize + 4);
+		paints = 0;
+
+		stopping = false;
+		loader = thread(&ChunkStreamer::load, this);
+	}
+
+	// destructor for the ChunkStreamer class
+	~ChunkStreamer() {
+		{
+			lock_guard<mutex> guard(lock);
+			stopping = true;
+		}
+		wake.notify_one();
+		loader.join();
+
+		for (map<int, Chunk*>::iterator it = resident.begin(); it != resident.end(); ++it)
+			delete it->second;
+		for (size_t i = 0; i < ready.size(); i++)
+			delete ready[i];
+	}
+
+	// shows the new state of a barrel in its chunk, if that chunk is loaded
+	void updateBarrel(int i) {
+		int index = world->rowOf(barrels[i].y) * world->cols + world->colOf(barrels[i].x);
+		map<int, Chunk*>::iterator it = resident.find(index);
+		if (it != resident.end())
+			applyLooks(it->second, i - barrelStart[index]);
+	}
+
+	// draws the ground and the obstacles of the chunks inside the rectangle
+	// chunks just outside are requested too, so that they are ready when the camera gets there
+	void paint(sf::FloatRect area) {
+		paints++;
+		adoptReady();
+
+		// obstacles reach past their position into the next chunk, so a margin is drawn as well
+		int c0 = world->colOf(area.left - 64);
+		int c1 = world->colOf(area.left + area.width + 64);
+		int r0 = world->rowOf(area.top - 64);
+		int r1 = world->rowOf(area.top + area.height + 64);
+
+		visible.clear();
+		bool requested = false;
+		for (int r = r0 - 1; r <= r1 + 1; r++) {
+			for (int c = c0 - 1; c <= c1 + 1; c++) {
+				if (r < 0 || c < 0 || r >= (int)world->rows || c >= (int)world->cols)
+					continue;
+				int index = r * world->cols + c;
+				map<int, Chunk*>::iterator it = resident.find(index);
+				if (it != resident.end()) {
+					it->second->lastUsed = paints;
+					if (r >= r0 && r <= r1 && c >= c0 && c <= c1)
+						visible.push_back(it->second);
+				}
+				else requested = request(index) || requested;
+			}
+		}
+		if (requested)
+			wake.notify_one();
+
+		// the grass of every chunk goes below the obstacles of every chunk
+		for (size_t i = 0; i < visible.size(); i++)
+			drawList->draw(visible[i]->ground, textures[GroundTexture]);
+		for (size_t i = 0; i < visible.size(); i++) {
+			drawList->draw(visible[i]->barrels, textures[BarrelTexture]);
+			drawList->draw(visible[i]->sandbags, textures[SandbagTexture]);
+		}
+
+		evict();
+	}
+
+private:
+	// texture slots, in the order of Level::ObjectType
+	enum { BarrelTexture, SandbagTexture, GroundTexture };
+
+	// queues a chunk for the loader thread, returns false if it was already queued
+	bool request(int index) {
+		lock_guard<mutex> guard(lock);
+		if (!pending.insert(index).second)
+			return false;
+		requests.push_back(index);
+		return true;
+	}
+
+	// moves the chunks the loader thread finished into the resident set
+	void adoptReady() {
+		arrived.clear();
+		{
+			lock_guard<mutex> guard(lock);
+			arrived.swap(ready);
+			for (size_t i = 0; i < arrived.size(); i++)
+				pending.erase(arrived[i]->index);
+		}
+		for (size_t i = 0; i < arrived.size(); i++) {
+			Chunk* chunk = arrived[i];
+			chunk->lastUsed = paints;
+			for (unsigned int k = 0; k < barrelStart[chunk->index + 1] - barrelStart[chunk->index]; k++)
+				applyLooks(chunk, k);
+			resident[chunk->index] = chunk;
+		}
+	}
+
+	// drops the least recently used chunks which the last two paints did not need
+	void evict() {
+		if (resident.size() <= capacity)
+			return;
+		// one pass finds all the chunks to drop, oldest first
+		ages.clear();
+		for (map<int, Chunk*>::iterator it = resident.begin(); it != resident.end(); ++it)
+			ages.push_back(make_pair(it->second->lastUsed, it->first));
+		size_t excess = resident.size() - capacity;
+		partial_sort(ages.begin(), ages.begin() + excess, ages.end());
+		for (size_t i = 0; i < excess && ages[i].first + 1 < paints; i++) {
+			map<int, Chunk*>::iterator it = resident.find(ages[i].second);
+			delete it->second;
+			resident.erase(it);
+		}
+	}
+
+	// makes the k-th barrel of the chunk transparent if it was destroyed, and shows the frame of
+	// its damage state otherwise
+	void applyLooks(Chunk* chunk, unsigned int k) {
+		unsigned int i = barrelStart[chunk->index] + k;
+		sf::Uint8 alpha = (*hidden)[i] ? 0 : 255;
+		float left = damage->get(i) * sizes[BarrelTexture].x;
+		for (unsigned int v = 0; v < 4; v++) {
+			chunk->barrels[k * 4 + v].color.a = alpha;
+			chunk->barrels[k * 4 + v].texCoords.x = v == 1 || v == 2 ? left + sizes[BarrelTexture].x : left;
+		}
+	}
+
+	// builds requested chunks until the streamer is destroyed
+	void load() {
+		unique_lock<mutex> guard(lock);
+		while (true) {
+			wake.wait(guard, [this] { return stopping || !requests.empty(); });
+			if (stopping)
+				return;
+			int index = requests.front();
+			requests.pop_front();
+
+			guard.unlock();
+			Chunk* chunk = build(index);
+			guard.lock();
+			ready.push_back(chunk);
+		}
+	}
+
+	// builds the vertices of a chunk, only reading the file and the texture sizes
+	Chunk* build(int index) {
+		Chunk* chunk = new Chunk;
+		chunk->index = index;
+		chunk->lastUsed = 0;
+
+		// the grass texture repeats, so its coordinates are simply the world coordinates
+		float left = (float)(index % world->cols * world->chunkSize);
+		float top = (float)(index / world->cols * world->chunkSize);
+		float right = fmin(left + world->chunkSize, (float)world->width);
+		float bottom = fmin(top + world->chunkSize, (float)world->height);
+		chunk->ground.setPrimitiveType(sf::Quads);
+		if (right > left && bottom > top)
+			addQuad(chunk->ground, sf::Vector2f(left, top), sf::Vector2f(right - left, bottom - top), sf::Vector2f(left, top));
+
+		chunk->barrels.setPrimitiveType(sf::Quads);
+		for (unsigned int i = barrelStart[index]; i < barrelStart[index + 1]; i++)
+			addObstacle(chunk->barrels, barrels[i], 0);
+		chunk->sandbags.setPrimitiveType(sf::Quads);
+		for (unsigned int i = sandbagStart[index]; i < sandbagStart[index + 1]; i++)
+			addObstacle(chunk->sandbags, sandbags[i], 1);
+		return chunk;
+	}
+
+	// adds the quad of an obstacle, placed like the sprite of an Object
+	void addObstacle(sf::VertexArray& vertices, Coord pos, int kind) {
+		sf::Vector2f size = sizes[kind];
+		sf::Vector2f corner(pos.x - size.x * 0.5f, pos.y - size.y * originY[kind]);
+		addQuad(vertices, corner, size, sf::Vector2f(0, 0));
+	}
+
+	// adds a textured rectangle
+	static void addQuad(sf::VertexArray& vertices, sf::Vector2f pos, sf::Vector2f size, sf::Vector2f texture) {
+		vertices.append(sf::Vertex(pos, texture));
+		vertices.append(sf::Vertex(sf::Vector2f(pos.x + size.x, pos.y), sf::Vector2f(texture.x + size.x, texture.y)));
+		vertices.append(sf::Vertex(pos + size, texture + size));
+		vertices.append(sf::Vertex(sf::Vector2f(pos.x, pos.y + size.y), sf::Vector2f(texture.x, texture.y + size.y)));
+	}
+};
+
+// Obstacles read straight from a mapped world file. The chunks of the file double as the
+// spatial grid, so only the pages around the players and bullets are ever touched;
+// the only memory kept per obstacle is one bit for every barrel telling whether it was destroyed,
+// and the damage states of the few barrels which are damaged.
+class ChunkedObstacleMap : public Obstacles {
+private:
+	const WorldHeader* world;
+	const unsigned int* barrelStart;
+	const unsigned int* sandbagStart;
+	const Coord* barrels;
+	const Coord* sandbags;
+	vector<bool> hidden;
+	SparseBytes damage;
+	ChunkStreamer* streamer; // only when the game is drawn
+
+public:
+	// constructor for the ChunkedObstacleMap class, see ChunkStreamer for the screen size and textures
+	ChunkedObstacleMap(const WorldHeader* world, DrawList* drawList, sf::Vector2u screen, sf::Texture* textures[3], float barrelOriginY, float sandbagOriginY) {
+		this->world = world;
+		barrelStart = world->barrelStart();
+		sandbagStart = world->sandbagStart();
+		barrels = world->barrels();
+		sandbags = world->sandbags();
+		hidden.assign(world->numBarrels, false);
+		streamer = drawList ? new ChunkStreamer(world, &hidden, &damage, drawList, screen, textures, barrelOriginY, sandbagOriginY) : nullptr;
+	}
+
+	// destructor for the ChunkedObstacleMap class
+	~ChunkedObstacleMap() {
+		delete streamer;
+	}
+
+	// returns the number of barrels
+	int getNumBarrels() {
+		return world->numBarrels;
+	}
+
+	// returns the number of sandbags
+	int getNumSandbags() {
+		return world->numSandbags;
+	}
+
+	// returns the position of a barrel
+	Coord getBarrelPosition(int i) {
+		return barrels[i];
+	}
+
+	// returns the position of a sandbag
+	Coord getSandbagPosition(int i) {
+		return sandbags[i];
+	}
+
+	// returns true if the barrel was not destroyed
+	bool isBarrelVisible(int i) {
+		return !hidden[i];
+	}
+
+	// shows how damaged a barrel is with a frame of the barrel texture
+	void setBarrelDamage(int i, int state) {
+		damage.set(i, (unsigned char)state);
+		if (streamer)
+			streamer->updateBarrel(i);
+	}
+
+	// returns true if an object at the position collides with a sandbag
+	bool hitSandbag(Coord pos) {
+		bool hit = false;
+		query(sandbagStart, pos.x - 30, pos.y - 30, pos.x + 30, pos.y + 30, [&](unsigned int i) {
+			if (!hit && touches(pos, sandbags[i]))
+				hit = true;
+		});
+		return hit;
+	}
+
+	// returns the index of a visible barrel an object at the position collides with, or -1
+	int hitBarrel(Coord pos) {
+		int hit = -1;
+		query(barrelStart, pos.x - 30, pos.y - 30, pos.x + 30, pos.y + 30, [&](unsigned int i) {
+			if (hit < 0 && !hidden[i] && touches(pos, barrels[i]))
+				hit = (int)i;
+		});
+		return hit;
+	}
+
+	// returns true if a bullet flying from a to b would be stopped by a sandbag
+	bool sandbagBetween(Coord a, Coord b) {
+		bool hit = false;
+		query(sandbagStart, fmin(a.x, b.x) - 30, fmin(a.y, b.y) - 30, fmax(a.x, b.x) + 30, fmax(a.y, b.y) + 30, [&](unsigned int i) {
+			if (!hit && segmentHits(a, b, sandbags[i]))
+				hit = true;
+		});
+		return hit;
+	}
+
+	// adds the sandbags and visible barrels of the chunks overlapping the rectangle
+	void findObstacles(float left, float top, float right, float bottom, vector<Coord>& positions) {
+		query(sandbagStart, left, top, right, bottom, [&](unsigned int i) {
+			positions.push_back(sandbags[i]);
+		});
+		query(barrelStart, left, top, right, bottom, [&](unsigned int i) {
+			if (!hidden[i])
+				positions.push_back(barrels[i]);
+		});
+	}
+
+	// draws the ground and the obstacles of the chunks inside the rectangle
+	void paint(sf::FloatRect area) {
+		streamer->paint(area);
+	}
+
+protected:
+	// hides or shows a barrel
+	void setBarrelVisible(int i, bool visible) {
+		hidden[i] = !visible;
+		if (streamer)
+			streamer->updateBarrel(i);
+	}
+
+private:
+	// calls visit(index) for the obstacles of the chunks overlapping the rectangle
+	template <class F>
+	void query(const unsigned int* start, float left, float top, float right, float bottom, F visit) {
+		int c0 = world->colOf(left);
+		int c1 = world->colOf(right);
+		int r0 = world->rowOf(top);
+		int r1 = world->rowOf(bottom);
+		for (int r = r0; r <= r1; r++)
+			for (int c = c0; c <= c1; c++)
+				for (unsigned int i = start[r * world->cols + c]; i < start[r * world->cols + c + 1]; i++)
+					visit(i);
+	}
+};
+
+// Weapon of a player: after every shot it has to cool down for a few ticks, and after the last
+// round of the magazine it reloads for a while. Only the simulation fires, so mashing the fire
+// key can not shoot faster than the weapon allows.
+class Weapon {
+private:
+	int cooldownTicks;
+	int magazineSize;
+	int reloadTicks;
+	int cooldown; // ticks until the weapon may fire again
+	int rounds;   // rounds left in the magazine
+	int reload;   // ticks until the magazine is full again, 0 when not reloading
+
+public:
+	// constructor for the Weapon class
+	Weapon() {
+		init(3, 8, 15);
+	}
+
+	// sets the ticks between shots, the size of the magazine and the ticks a reload takes
+	void init(int cooldownTicks, int magazineSize, int reloadTicks) {
+		this->cooldownTicks = cooldownTicks;
+		this->magazineSize = magazineSize;
+		this->reloadTicks = reloadTicks;
+		reset();
+	}
+
+	// fills the magazine, ready to fire
+	void reset() {
+		cooldown = 0;
+		rounds = magazineSize;
+		reload = 0;
+	}
+
+	// advances the cooldown and the reload by one tick
+	void update() {
+		if (cooldown > 0)
+			cooldown--;
+		if (reload > 0 && --reload == 0)
+			rounds = magazineSize;
+	}
+
+	// returns true if the weapon may fire in this tick
+	bool canFire() {
+		return cooldown == 0 && rounds > 0;
+	}
+
+	// uses a round, the last one starts the reload
+	void fire() {
+		rounds--;
+		cooldown = cooldownTicks;
+		if (rounds == 0)
+			reload = reloadTicks;
+	}
+
+	// returns the rounds left in the magazine
+	int getRounds() {
+		return rounds;
+	}
+
+	// returns true while the magazine is reloaded
+	bool isReloading() {
+		return reload > 0;
+	}
+};
+
+// Player class inherits from base Object class
+class Player : public Object {
+private:
+	sf::Texture textures[14];
+	int score;
+	int bulletState; // state of the player when the bullet was fired
+	int aim;         // direction of the shots in steps of Directions, -1 to shoot where the player faces
+	unsigned int seed; // state of the player's random number generator
+	Weapon weapon;
+
+public:
+	enum WalkDirection { Left, Up, Right, Down };
+
+	// destructor for the Player class
+	~Player() {
+		TextureCache::instance().untrack(textures, 14);
+	}
+
+	// initializes the player
+	void init(DrawList* drawList, Coord pos) {
+
+		// load textures
+		if (drawList) {
+			loadTextures();
+		}
+		setTexture(textures[0]);
+
+		// initialize base Object class
+		Object::init(drawList, string(), pos);
+
+		reset(pos);
+	}
+
+	// puts the player at the position as at the start of a game, keeping the textures
+	void reset(Coord pos) {
+		setTexture(textures[0]);
+		setPosition(pos.x, pos.y);
+		score = 0;
+		bulletState = 1;
+		aim = -1;
+		seed = 1;
+		weapon.reset();
+	}
+
+	// loads the walking animation textures
+	void loadTextures() {
+		TRACE_BEGIN("Player::loadTextures");
+		for (int i = 0; i < 14; i++) {
+			string path = "soldier" + to_string(i) + ".png";
+			TextureCache::instance().load(path, textures[i]);
+			TextureCache::instance().track(path, &textures[i]);
+		}
+		TRACE_END("Player::loadTextures");
+	}
+
+	// checks whether player collides with one of the other objects
+	bool checkCollision(Obstacles& obstacles) {
+		// collide the player with sandbags and visible barrels
+		return obstacles.collides(getPosition());
+	}
+
+	// sets the current score of the player
+	void setScore(int score) {
+		this->score = score;
+	}
+
+	// increments score of the player
+	void incrementScore() {
+		score++;
+	}
+
+	// returns the current score of the player
+	int getScore() {
+		return score;
+	}
+
+	// returns the state of the player when the bullet was fired
+	int getBulletState() {
+		return bulletState;
+	}
+
+	// returns the direction of the player's shots in steps of Directions
+	int getAim() {
+		// states 0..3 are right, up, left and down, a quarter turn apart
+		return aim >= 0 ? aim : bulletState * Directions::count / 4;
+	}
+
+	// aims the player's shots in a direction given in steps of Directions, -1 to shoot where the player faces
+	void setAim(int aim) {
+		this->aim = aim;
+	}
+
+	// returns the weapon of the player
+	Weapon& getWeapon() {
+		return weapon;
+	}
+
+	// seeds the player's random number generator, so that matches can be replayed
+	void setSeed(unsigned int seed) {
+		this->seed = seed;
+	}
+
+	// returns a random number between a and b
+	float random(float a, float b) {
+		// linear congruential generator, every player has its own so games can run in parallel
+		seed = seed * 1103515245u + 12345u;
+		float r = ((seed >> 16) % 1000) / 1000.0f;
+		return a + (b - a) * r;
+	}
+
+	// respawns the player at a random location which is not blocked by an obstacle
+	void respawn(float width, float height, Obstacles& obstacles) {
+		const float border = 50;
+		// a player spawned inside an obstacle could never walk out of it again
+		for (int tries = 0; tries < 100; tries++) {
+			float x = random(border, width - border);
+			float y = random(border, height - border);
+			setPosition(x, y);
+			if (!checkCollision(obstacles))
+				break;
+		}
+	}
+
+	// soldier walk function for 4 directions. Last texture checking in for loop, next state decided according to that.
+	void walk(float speed, WalkDirection dir) {
+		if (dir == Up) {
+			for (int i = 0; i < 14; i++) {
+				if (getTexture() == &textures[i]) {
+					if (i == 0) {
+						setTexture(textures[8]);
+						break;
+					}if (i == 1) {
+						setTexture(textures[0]);
+						break;
+					}if (i == 2) {
+						setTexture(textures[1]);
+						break;
+					}if (i == 3) {
+						setTexture(textures[2]);
+						break;
+					}if (i == 4) {
+						setTexture(textures[5]);
+						break;
+					}if (i == 5) {
+						setTexture(textures[6]);
+						break;
+					}if (i == 6) {
+						setTexture(textures[0]);
+						break;
+					}if (i == 7) {
+						setTexture(textures[8]);
+						break;
+					}if (i == 8) {
+						setTexture(textures[7]);
+						break;
+					}if (i == 9) {
+						setTexture(textures[2]);
+						break;
+					}if (i == 10) {
+						setTexture(textures[1]);
+						break;
+					}if (i == 11) {
+						setTexture(textures[5]);
+						break;
+					}if (i == 12) {
+						setTexture(textures[7]);
+						break;
+					}if (i == 13) {
+						setTexture(textures[12]);
+						break;
+					}
+				}
+			}
+
+			move(0, -speed);
+
+		}
+		else if (dir == Down) {
+			for (int i = 0; i < 14; i++) {
+				if (getTexture() == &textures[i]) {
+					if (i == 0) {
+						setTexture(textures[1]);
+						break;
+					}if (i == 1) {
+						setTexture(textures[2]);
+						break;
+					}if (i == 2) {
+						setTexture(textures[3]);
+						break;
+					}if (i == 3) {
+						setTexture(textures[11]);
+						break;
+					}if (i == 4) {
+						setTexture(textures[3]);
+						break;
+					}if (i == 5) {
+						setTexture(textures[4]);
+						break;
+					}if (i == 6) {
+						setTexture(textures[5]);
+						break;
+					}if (i == 7) {
+						setTexture(textures[6]);
+						break;
+					}if (i == 8) {
+						setTexture(textures[7]);
+						break;
+					}if (i == 9) {
+						setTexture(textures[3]);
+						break;
+					}if (i == 10) {
+						setTexture(textures[9]);
 						break;
-					}if (i == 4) {
+					}if (i == 11) {
 						setTexture(textures[3]);
 						break;
-					}if (i == 5) {
+					}if (i == 12) {
+						setTexture(textures[13]);
+						break;
+					}if (i == 13) {
+						setTexture(textures[5]);
+						break;
+					}
+				}
+			}
+			move(0, speed);
+		}
+		else if (dir == Left) {
+			for (int i = 0; i < 14; i++) {
+				if (getTexture() == &textures[i]) {
+					if (i == 0) {
+						setTexture(textures[7]);
+						break;
+					}if (i == 1) {
+						setTexture(textures[0]);
+						break;
+					}if (i == 2) {
+						setTexture(textures[1]);
+						break;
+					}if (i == 3) {
 						setTexture(textures[4]);
 						break;
-					}if (i == 6) {
+					}if (i == 4) {
 						setTexture(textures[5]);
 						break;
+					}if (i == 5) {
+						setTexture(textures[6]);
+						break;
+					}if (i == 6) {
+						setTexture(textures[13]);
+						break;
 					}if (i == 7) {
 						setTexture(textures[6]);
 						break;
@@ -320,718 +3739,4405 @@ public:
 						setTexture(textures[7]);
 						break;
 					}if (i == 9) {
-						setTexture(textures[3]);
+						setTexture(textures[10]);
 						break;
 					}if (i == 10) {
-						setTexture(textures[9]);
+						setTexture(textures[7]);
 						break;
 					}if (i == 11) {
-						setTexture(textures[3]);
+						setTexture(textures[7]);
 						break;
 					}if (i == 12) {
 						setTexture(textures[13]);
 						break;
 					}if (i == 13) {
-						setTexture(textures[5]);
+						setTexture(textures[12]);
+						break;
+					}
+				}
+			}
+			move(-speed, 0);
+		}
+		else if (dir == Right) {
+			for (int i = 0; i < 14; i++) {
+				if (getTexture() == &textures[i]) {
+					if (i == 0) {
+						setTexture(textures[1]);
+						break;
+					}if (i == 1) {
+						setTexture(textures[2]);
+						break;
+					}if (i == 2) {
+						setTexture(textures[10]);
+						break;
+					}if (i == 3) {
+						setTexture(textures[2]);
+						break;
+					}if (i == 4) {
+						setTexture(textures[3]);
+						break;
+					}if (i == 5) {
+						setTexture(textures[6]);
+						break;
+					}if (i == 6) {
+						setTexture(textures[7]);
+						break;
+					}if (i == 7) {
+						setTexture(textures[8]);
+						break;
+					}if (i == 8) {
+						setTexture(textures[0]);
+						break;
+					}if (i == 9) {
+						setTexture(textures[2]);
+						break;
+					}if (i == 10) {
+						setTexture(textures[2]);
+						break;
+					}if (i == 11) {
+						setTexture(textures[4]);
+						break;
+					}if (i == 12) {
+						setTexture(textures[6]);
+						break;
+					}if (i == 13) {
+						setTexture(textures[2]);
+						break;
+					}
+				}
+			}
+			move(speed, 0);
+		}
+
+		bulletState = 0;
+		if (getTexture() == &textures[0] || getTexture() == &textures[1] || getTexture() == &textures[7] || getTexture() == &textures[8])
+			bulletState = 1;
+		if (getTexture() == &textures[6] || getTexture() == &textures[12] || getTexture() == &textures[13])
+			bulletState = 2;
+		if (getTexture() == &textures[3] || getTexture() == &textures[4] || getTexture() == &textures[5] || getTexture() == &textures[11])
+			bulletState = 3;
+	}
+
+	// checks which key released
+	void checkKeyrelease(WalkDirection dir) {
+		if (dir == Up) {
+			// we can make this code for only soldier 7 and 8. Because soldier7 and soldier8 are available while soldier walks upwards.
+			for (int i = 0; i < 14; i++) {
+				if (getTexture() == &textures[i]) {
+					if (i == 0) {
+						break;
+					}if (i == 1) {
+					}if (i == 2) {
+					}if (i == 3) {
+					}if (i == 4) {
+					}if (i == 5) {
+					}if (i == 6) {
+					}if (i == 7) {
+						setTexture(textures[0]);
+					}if (i == 8) {
+						setTexture(textures[0]);
+					}if (i == 9) {
+					}if (i == 10) {
+					}if (i == 11) {
+					}if (i == 12) {
+					}if (i == 13) {
+					}
+				}
+			}
+		}
+		if (dir == Down) {
+			for (int i = 0; i < 14; i++) {
+				if (getTexture() == &textures[i]) {
+					if (i == 0) {
+					}
+					if (i == 1) {
+					}
+					if (i == 2) {
+					}
+					if (i == 3) {
+						setTexture(textures[4]);
+					}
+					if (i == 4) {
+						break;
+					}
+					if (i == 5) {
+					}
+					if (i == 6) {
+					}
+					if (i == 7) {
+					}
+					if (i == 8) {
+					}
+					if (i == 9) {
+					}
+					if (i == 10) {
+					}
+					if (i == 11) {
+						setTexture(textures[4]);
+					}
+					if (i == 12) {
+					}
+					if (i == 13) {
+					}
+				}
+			}
+		}
+		if (dir == Left) {
+			for (int i = 0; i < 14; i++) {
+				if (getTexture() == &textures[i]) {
+					if (i == 0) {
+					}
+					if (i == 1) {
+					}
+					if (i == 2) {
+					}
+					if (i == 3) {
+					}
+					if (i == 4) {
+					}
+					if (i == 5) {
+					}
+					if (i == 6) {
+						break;
+					}
+					if (i == 7) {
+					}
+					if (i == 8) {
+					}
+					if (i == 9) {
+					}
+					if (i == 10) {
+					}
+					if (i == 11) {
+					}
+					if (i == 12) {
+						setTexture(textures[6]);
+					}
+					if (i == 13) {
+						setTexture(textures[6]);
+					}
+				}
+			}
+		}
+		if (dir == Right) {
+			for (int i = 0; i < 14; i++) {
+				if (getTexture() == &textures[i]) {
+					if (i == 0) {
+					}
+					if (i == 1) {
+					}
+					if (i == 2) {
 						break;
 					}
+					if (i == 3) {
+					}
+					if (i == 4) {
+					}
+					if (i == 5) {
+					}
+					if (i == 6) {
+					}
+					if (i == 7) {
+					}
+					if (i == 8) {
+					}
+					if (i == 9) {
+						setTexture(textures[2]);
+					}
+					if (i == 10) {
+						setTexture(textures[2]);
+					}
+					if (i == 11) {
+					}
+					if (i == 12) {
+					}
+					if (i == 13) {
+					}
+				}
+			}
+		}
+	}
+};
+
+// Something which happened in the simulation. The system causing it publishes the event into the
+// EventQueue, and the systems which care about it react to it, so that none has to change the others.
+class GameEvent {
+public:
+	enum Kind { PlayerKilled, SandbagHit, BarrelDamaged, BarrelDestroyed, BulletExpired, NumKinds };
+	Kind kind;
+	Coord pos;
+	int subject;    // player killed, or barrel damaged or destroyed, -1 for the other kinds
+	int instigator; // player whose bullet caused the event
+
+	// constructor for the GameEvent class
+	GameEvent() {}
+
+	// constructor for the GameEvent class
+	GameEvent(Kind kind, Coord pos, int subject, int instigator) {
+		this->kind = kind;
+		this->pos = pos;
+		this->subject = subject;
+		this->instigator = instigator;
+	}
+};
+
+// System reacting to game events, see EventQueue::subscribe
+class EventListener {
+public:
+	// destructor for the EventListener class
+	virtual ~EventListener() {}
+
+	// reacts to an event of a kind the listener subscribed to
+	virtual void onEvent(const GameEvent& event) = 0;
+};
+
+// Game events waiting for their listeners. The events live in a ring allocated once, so heavy fire
+// never allocates; they are dispatched once per tick in the order they were published, and the
+// events the listeners publish in turn are dispatched in the same go.
+class EventQueue {
+private:
+	GameEvent* events;
+	unsigned int capacity; // a power of two
+	unsigned int head;     // next event to dispatch
+	unsigned int tail;     // where the next event goes
+	int dropped;           // events which did not fit
+	static const int maxListeners = 8;
+	EventListener* listeners[maxListeners];
+	unsigned int kinds[maxListeners]; // bit k set if the listener wants events of kind k
+	int numListeners;
+
+public:
+	// constructor for the EventQueue class, the queue holds at least capacity events
+	EventQueue(unsigned int capacity) {
+		this->capacity = 1;
+		while (this->capacity < capacity)
+			this->capacity *= 2;
+		events = new GameEvent[this->capacity];
+		head = 0;
+		tail = 0;
+		dropped = 0;
+		numListeners = 0;
+	}
+
+	// destructor for the EventQueue class
+	~EventQueue() {
+		delete[] events;
+	}
+
+	// returns the bit of an event kind, for subscribe
+	static unsigned int bit(GameEvent::Kind kind) {
+		return 1u << kind;
+	}
+
+	// hands the events of the kinds, an or of their bits, to the listener
+	// returns false if there is no room for another listener, the listener then gets nothing
+	bool subscribe(EventListener* listener, unsigned int kinds) {
+		if (numListeners == maxListeners)
+			return false;
+		listeners[numListeners] = listener;
+		this->kinds[numListeners] = kinds;
+		numListeners++;
+		return true;
+	}
+
+	// stops handing events to the listener, before it is destroyed
+	void unsubscribe(EventListener* listener) {
+		int kept = 0;
+		for (int i = 0; i < numListeners; i++) {
+			if (listeners[i] != listener) {
+				listeners[kept] = listeners[i];
+				kinds[kept] = kinds[i];
+				kept++;
+			}
+		}
+		numListeners = kept;
+	}
+
+	// queues an event for the next dispatch, returns false if the queue is full and the event was dropped
+	bool publish(const GameEvent& event) {
+		if (tail - head == capacity) {
+			dropped++;
+			return false;
+		}
+		events[tail++ & (capacity - 1)] = event;
+		return true;
+	}
+
+	// hands every queued event to its listeners
+	void dispatch() {
+		while (head != tail) {
+			// copied, a listener may publish into the slot
+			GameEvent event = events[head++ & (capacity - 1)];
+			for (int i = 0; i < numListeners; i++)
+				if (kinds[i] & bit(event.kind))
+					listeners[i]->onEvent(event);
+		}
+	}
+
+	// forgets the queued events
+	void clear() {
+		head = tail;
+	}
+
+	// returns the number of queued events
+	int getSize() {
+		return (int)(tail - head);
+	}
+
+	// returns the number of events which were dropped because the queue was full
+	int getDropped() {
+		return dropped;
+	}
+};
+
+// Turned copies of an image on one texture, one frame per direction. Drawing a frame only
+// copies its corners and texture coordinates out of a table, no transform is computed.
+class SpriteAtlas {
+private:
+	class Frame {
+	public:
+		sf::Vector2f corners[4];   // relative to the center of the image
+		sf::Vector2f texCoords[4];
+	};
+
+	sf::Texture texture;
+	vector<Frame> frames;
+
+public:
+	// destructor for the SpriteAtlas class
+	~SpriteAtlas() {
+		TextureCache::instance().untrack(&texture, 1);
+	}
+
+	// builds n frames of the image, frame f points f / n of a full turn counterclockwise from the
+	// right; the image itself points up. Returns false if it can not be loaded
+	bool build(string path, int n) {
+		// a bundle holds the atlas ready made, see AssetPacker
+		if (TextureCache::instance().loadFromBundle(path + "#atlas" + to_string(n), texture)) {
+			layout(TextureCache::instance().getSize(texture).x / columns(n), n);
+			return true;
+		}
+		sf::Image atlas;
+		if (!render(path, n, atlas))
+			return false;
+		layout(atlas.getSize().x / columns(n), n);
+		return TextureCache::instance().loadFromImage(atlas, texture);
+	}
+
+	// turns the image into the atlas image of build, returns false if it can not be loaded
+	static bool render(string path, int n, sf::Image& atlas) {
+		sf::Image image;
+		if (!image.loadFromFile(path))
+			return false;
+		int w = (int)image.getSize().x;
+		int h = (int)image.getSize().y;
+		// every turn of the image fits into a square cell as wide as its diagonal
+		int cell = (int)ceil(sqrt((float)(w * w + h * h)));
+		int rows = (n + columns(n) - 1) / columns(n);
+
+		atlas.create(cell * columns(n), cell * rows, sf::Color::Transparent);
+		for (int f = 0; f < n; f++) {
+			// the image is turned from pointing up to the frame's direction
+			int step = (f * Directions::count / n - Directions::count / 4) & (Directions::count - 1);
+			float c = directions.cosine[step];
+			float s = directions.sine[step];
+			int left = f % columns(n) * cell;
+			int top = f / columns(n) * cell;
+			for (int y = 0; y < cell; y++)
+				for (int x = 0; x < cell; x++)
+					atlas.setPixel(left + x, top + y, sample(image, x - cell * 0.5f, y - cell * 0.5f, c, s));
+		}
+		return true;
+	}
+
+	// returns true if the frames were built
+	bool isLoaded() {
+		return !frames.empty();
+	}
+
+	// records a frame centered on the position
+	void paint(DrawList* drawList, int frame, float x, float y) {
+		const Frame& f = frames[frame];
+		sf::Vertex* quad = drawList->addQuads(&texture, 1);
+		for (int k = 0; k < 4; k++)
+			quad[k] = sf::Vertex(sf::Vector2f(x + f.corners[k].x, y + f.corners[k].y), f.texCoords[k]);
+	}
+
+private:
+	// returns the number of frames side by side in an atlas of n frames
+	static int columns(int n) {
+		return n < 8 ? n : 8;
+	}
+
+	// points the n frames at their square cells of the given size
+	void layout(int cell, int n) {
+		frames.resize(n);
+		for (int f = 0; f < n; f++) {
+			int left = f % columns(n) * cell;
+			int top = f / columns(n) * cell;
+			Frame& frame = frames[f];
+			float half = cell * 0.5f;
+			frame.corners[0] = sf::Vector2f(-half, -half);
+			frame.corners[1] = sf::Vector2f(half, -half);
+			frame.corners[2] = sf::Vector2f(half, half);
+			frame.corners[3] = sf::Vector2f(-half, half);
+			frame.texCoords[0] = sf::Vector2f((float)left, (float)top);
+			frame.texCoords[1] = sf::Vector2f((float)(left + cell), (float)top);
+			frame.texCoords[2] = sf::Vector2f((float)(left + cell), (float)(top + cell));
+			frame.texCoords[3] = sf::Vector2f((float)left, (float)(top + cell));
+		}
+	}
+
+	// returns the color of the turned image at the pixel (x, y) relative to the center, averaged
+	// over 4 x 4 points of the pixel so that the edges of thin images stay smooth
+	static sf::Color sample(const sf::Image& image, float x, float y, float c, float s) {
+		int w = (int)image.getSize().x;
+		int h = (int)image.getSize().y;
+		float r = 0, g = 0, b = 0, a = 0;
+		for (int k = 0; k < 16; k++) {
+			float px = x + (k % 4 + 0.5f) / 4;
+			float py = y + (k / 4 + 0.5f) / 4;
+			// turn the point back into the image, y grows downwards on the screen
+			int ix = (int)floor(c * px - s * py + w * 0.5f);
+			int iy = (int)floor(s * px + c * py + h * 0.5f);
+			if (ix < 0 || ix >= w || iy < 0 || iy >= h)
+				continue;
+			sf::Color p = image.getPixel(ix, iy);
+			r += p.r * p.a;
+			g += p.g * p.a;
+			b += p.b * p.a;
+			a += p.a;
+		}
+		if (a == 0)
+			return sf::Color::Transparent;
+		return sf::Color((sf::Uint8)(r / a), (sf::Uint8)(g / a), (sf::Uint8)(b / a), (sf::Uint8)(a / 16));
+	}
+};
+
+// Bullet list class, the bullets are entities of the World with a velocity and a collider
+// they fly in any of the steps of Directions and are drawn from an atlas frame close to it
+class BulletList {
+public:
+	static const int numFrames = 32; // frames of the atlas, a divisor of Directions::count
+
+private:
+	World* world;
+	DrawList* drawList;
+	SpriteAtlas atlas;
+	float width;
+	float height;
+	int hits;             // number of bullets which hit a player
+	vector<Entity> flying; // bullets in flight, in the order of their entities
+	int maxBullets;       // bullets of all players together may not exceed this
+	int rejected;         // bullets which were not fired because of maxBullets
+	EventQueue* events;   // gets what the bullets ran into
+	FrameArena* arena;
+	enum Contact { NoContact, EdgeContact, SandbagContact, BarrelContact };
+
+public:
+	// constructor for the BulletList class
+	BulletList(World* world, FrameArena* arena, EventQueue* events, DrawList* drawList, float width, float height, int maxBullets) {
+		this->world = world;
+		this->drawList = drawList;
+		this->arena = arena;
+		this->events = events;
+		this->width = width;
+		this->height = height;
+		this->maxBullets = maxBullets;
+		hits = 0;
+		rejected = 0;
+		flying.reserve(maxBullets);
+
+		// headless games draw nothing
+		if (drawList) {
+			TRACE_BEGIN("SpriteAtlas::build");
+			atlas.build("bullet.png", numFrames);
+			TRACE_END("SpriteAtlas::build");
+		}
+	}
+
+	// returns the number of bullets which hit a player
+	int getHits() {
+		return hits;
+	}
+
+	// returns the number of bullets which were not fired because too many were in flight
+	int getRejected() {
+		return rejected;
+	}
+
+	// returns the number of bullets in flight
+	int getNumBullets() {
+		return (int)flying.size();
+	}
+
+	// returns the entity of the i-th bullet in flight
+	Entity getBullet(int i) {
+		return flying[i];
+	}
+
+	// adds a new bullet flying in a direction, given in steps of Directions
+	// returns false if the bullets in flight already use up the budget, the shot is then refused
+	bool add(Coord pos, int direction, int owner) {
+		if ((int)flying.size() == maxBullets) {
+			rejected++;
+			return false;
+		}
+		TRACE_BEGIN("BulletList::add");
+
+		Entity bullet = world->create(World::TransformBit | World::VelocityBit | World::SpriteBit | World::ColliderBit);
+		flying.insert(lower_bound(flying.begin(), flying.end(), bullet), bullet);
+		int step = direction & (Directions::count - 1);
+		Transform& transform = world->transform(bullet);
+		transform.x = pos.x;
+		transform.y = pos.y;
+		world->velocity(bullet).x = +40 * directions.cosine[step];
+		world->velocity(bullet).y = -40 * directions.sine[step];
+		world->collider(bullet).radius = 15;
+		world->collider(bullet).owner = owner;
+		// the frame closest to the direction
+		int stepsPerFrame = Directions::count / numFrames;
+		world->sprite(bullet).frame = (step + stepsPerFrame / 2) / stepsPerFrame % numFrames;
+		TRACE_END("BulletList::add");
+		return true;
+	}
+
+	// removes every bullet in flight
+	// the last one is destroyed first, so that the next bullets get their slots in order again
+	void clear() {
+		for (int i = (int)flying.size() - 1; i >= 0; i--)
+			world->destroy(flying[i]);
+		flying.clear();
+	}
+
+	// removes every bullet and forgets the counts, for a new game
+	void reset() {
+		clear();
+		hits = 0;
+		rejected = 0;
+	}
+
+	// moves every bullet
+	void update(JobSystem* jobs) {
+		TRACE_BEGIN("BulletList::update");
+		world->move(flying, jobs);
+		TRACE_END("BulletList::update");
+	}
+
+	// checks whether a bullet collided with other objects or with the edge of the screen
+	// everything a bullet runs into is published as an event, nothing is changed before they are dispatched
+	void checkCollision(Player* players, int np, Obstacles& obstacles, JobSystem* jobs) {
+		TRACE_BEGIN("BulletList::checkCollision");
+		// the obstacles around every bullet are looked up in parallel, the hits are then handled
+		// in the order of the bullets, exactly as if everything ran on one thread
+		int n = (int)flying.size();
+		FrameVector<unsigned char> contacts(n, NoContact, ArenaAllocator<unsigned char>(arena));
+		JobSystem::parallelFor(jobs, n, 256, [&](int begin, int end) {
+			for (int k = begin; k < end; k++)
+				contacts[k] = findContact(flying[k], obstacles);
+		});
+
+		// a player killed by one bullet is not hit by the next ones
+		// the bullets which fly on are moved together, keeping their order
+		FrameVector<unsigned char> killed(np, 0, ArenaAllocator<unsigned char>(arena));
+		int kept = 0;
+		for (int k = 0; k < n; k++) {
+			Entity bullet = flying[k];
+			if (hitSomething(bullet, contacts[k], players, np, &killed[0], obstacles))
+				world->destroy(bullet);
+			else flying[kept++] = bullet;
+		}
+		flying.resize(kept);
+		TRACE_END("BulletList::checkCollision");
+	}
+
+	// draws the bullets inside the rectangle
+	void paint(sf::FloatRect area) {
+		if (!atlas.isLoaded())
+			return;
+		TRACE_BEGIN("BulletList::paint");
+		for (Entity bullet : flying) {
+			Coord pos = world->getPosition(bullet);
+			if (area.contains(pos.x, pos.y))
+				atlas.paint(drawList, world->sprite(bullet).frame, pos.x, pos.y);
+		}
+		TRACE_END("BulletList::paint");
+	}
+
+private:
+	// returns what a bullet touches apart from the players, the obstacles are only read
+	// obstacles only change when the events are dispatched, after the hits are handled
+	unsigned char findContact(Entity bullet, Obstacles& obstacles) {
+		Coord pos = world->getPosition(bullet);
+		if (pos.x < 0 || pos.x > width || pos.y < 0 || pos.y > height)
+			return EdgeContact;
+		if (obstacles.hitSandbag(pos))
+			return SandbagContact;
+		if (obstacles.hitBarrel(pos) >= 0)
+			return BarrelContact;
+		return NoContact;
+	}
+
+	// returns true if the bullet ran into the edge of the screen, a player or an obstacle
+	bool hitSomething(Entity bullet, unsigned char contact, Player* players, int np, unsigned char* killed, Obstacles& obstacles) {
+		Coord pos = world->getPosition(bullet);
+		int owner = world->collider(bullet).owner;
+
+		// collide the bullet with the edge of the screen
+		if (contact == EdgeContact) {
+			events->publish(GameEvent(GameEvent::BulletExpired, pos, -1, owner));
+			return true;
+		}
+
+		// collide the bullet with players
+		for (int i = 0; i < np; i++) {
+			if (i != owner && !killed[i] && world->collides(bullet, players[i].getPosition(), 15)) {
+				hits++;
+				killed[i] = 1;
+				events->publish(GameEvent(GameEvent::PlayerKilled, players[i].getPosition(), i, owner));
+				return true;
+			}
+		}
+
+		// collide the bullet with the sandbags and visible barrels around it
+		if (contact == SandbagContact) {
+			events->publish(GameEvent(GameEvent::SandbagHit, pos, -1, owner));
+			return true;
+		}
+		if (contact != BarrelContact)
+			return false;
+		int barrel = obstacles.hitBarrel(pos);
+		events->publish(GameEvent(GameEvent::BarrelDamaged, obstacles.getBarrelPosition(barrel), barrel, owner));
+		return true;
+	}
+};
+
+// Hit points of the barrels. A barrel takes a few hits, looking more damaged after each one, before
+// it is destroyed, and comes back a while after that. Bullets only report the hits as events, and
+// the destruction is published in turn for the effects and the bots. The barrels take the hits
+// once they are subscribed to BarrelDamaged.
+class BarrelHealth : public EventListener {
+private:
+	// a destroyed barrel waiting to come back
+	class Wreck {
+	public:
+		int barrel;
+		int respawnTick;
+	};
+
+	Obstacles* obstacles;
+	EventQueue* events;
+	int maxHp;
+	int respawnTicks;
+	SparseBytes hits;         // hits taken by the barrels which were hit, maxHp while destroyed
+	vector<Wreck> wrecks;
+	int ticks;
+	int destroyed;            // barrels destroyed so far
+
+public:
+	// constructor for the BarrelHealth class, a destroyed barrel comes back after respawnTicks
+	BarrelHealth(Obstacles* obstacles, EventQueue* events, int maxHp, int respawnTicks) {
+		this->obstacles = obstacles;
+		this->events = events;
+		this->maxHp = maxHp;
+		this->respawnTicks = respawnTicks;
+		ticks = 0;
+		destroyed = 0;
+	}
+
+	// returns the number of barrels destroyed so far
+	int getDestroyed() {
+		return destroyed;
+	}
+
+	// takes a hit point of the barrel, destroying it with the last one
+	void onEvent(const GameEvent& event) {
+		int i = event.subject;
+		// more bullets of the same tick may hit a barrel which is already destroyed
+		int taken = hits.get(i);
+		if (taken == maxHp)
+			return;
+		taken++;
+		hits.set(i, (unsigned char)taken);
+		if (taken < maxHp) {
+			obstacles->setBarrelDamage(i, taken * Obstacles::numDamageStates / maxHp);
+			return;
+		}
+		obstacles->hideBarrel(i);
+		destroyed++;
+		Wreck wreck;
+		wreck.barrel = i;
+		wreck.respawnTick = ticks + respawnTicks;
+		wrecks.push_back(wreck);
+		events->publish(GameEvent(GameEvent::BarrelDestroyed, event.pos, i, event.instigator));
+	}
+
+	// advances the time by one tick and brings back the barrels whose time has come,
+	// unless a player stands where the barrel would appear
+	void update(Player* players, int np) {
+		ticks++;
+		size_t kept = 0;
+		for (size_t k = 0; k < wrecks.size(); k++) {
+			Wreck wreck = wrecks[k];
+			if (wreck.respawnTick <= ticks && !occupied(obstacles->getBarrelPosition(wreck.barrel), players, np))
+				restore(wreck.barrel);
+			else wrecks[kept++] = wreck;
+		}
+		wrecks.resize(kept);
+	}
+
+	// brings every barrel back intact, for a new game
+	void reset() {
+		wrecks.clear();
+		for (int k = 0; k < hits.getSize(); k++) {
+			obstacles->setBarrelDamage(hits.getBarrel(k), 0);
+			obstacles->showBarrel(hits.getBarrel(k));
+		}
+		hits.clear();
+		ticks = 0;
+		destroyed = 0;
+	}
+
+private:
+	// returns true if a player touches the position
+	static bool occupied(Coord pos, Player* players, int np) {
+		for (int i = 0; i < np; i++)
+			if (Obstacles::touches(pos, players[i].getPosition()))
+				return true;
+		return false;
+	}
+
+	// gives the barrel all its hit points back and shows it intact
+	void restore(int i) {
+		hits.set(i, 0);
+		obstacles->setBarrelDamage(i, 0);
+		obstacles->showBarrel(i);
+	}
+};
+
+// Short-lived particles for explosions, debris and muzzle flashes. All particles live in one
+// fixed pool with a separate array per attribute, so that the update is a straight loop over
+// floats which the compiler vectorizes, and all of them are drawn with a single vertex array.
+class ParticleSystem : public EventListener {
+private:
+	DrawList* drawList;
+	int capacity;
+	int count;      // the live particles are the first count entries of every array
+	float* x;
+	float* y;
+	float* vx;
+	float* vy;
+	float* life;    // frames left to live
+	float* fade;    // 1 / frames the particle lived at the start, for fading it out
+	float* size;
+	sf::Color* color;
+	sf::VertexArray vertices;
+	unsigned int seed;
+
+public:
+	// constructor for the ParticleSystem class
+	ParticleSystem(DrawList* drawList, int capacity) {
+		this->drawList = drawList;
+		this->capacity = capacity;
+		count = 0;
+		x = new float[capacity];
+		y = new float[capacity];
+		vx = new float[capacity];
+		vy = new float[capacity];
+		life = new float[capacity];
+		fade = new float[capacity];
+		size = new float[capacity];
+		color = new sf::Color[capacity];
+		vertices.setPrimitiveType(sf::Quads);
+		seed = 1;
+	}
+
+	// destructor for the ParticleSystem class
+	~ParticleSystem() {
+		delete[] x;
+		delete[] y;
+		delete[] vx;
+		delete[] vy;
+		delete[] life;
+		delete[] fade;
+		delete[] size;
+		delete[] color;
+	}
+
+	// returns the number of live particles
+	int getCount() {
+		return count;
+	}
+
+	// removes every particle
+	void clear() {
+		count = 0;
+		seed = 1;
+	}
+
+	// adds a particle, when the pool is full it is dropped
+	void add(Coord pos, float speedX, float speedY, float frames, float pixels, sf::Color tint) {
+		if (count == capacity)
+			return;
+		x[count] = pos.x;
+		y[count] = pos.y;
+		vx[count] = speedX;
+		vy[count] = speedY;
+		life[count] = frames;
+		fade[count] = 1 / frames;
+		size[count] = pixels;
+		color[count] = tint;
+		count++;
+	}
+
+	// makes destroyed barrels explode
+	void onEvent(const GameEvent& event) {
+		if (event.kind == GameEvent::BarrelDestroyed)
+			explode(event.pos);
+	}
+
+	// throws fire and debris in all directions from an exploding barrel
+	void explode(Coord pos) {
+		for (int i = 0; i < 120; i++) {
+			float angle = random(0, 2 * pi);
+			float speed = random(1, 8);
+			add(pos, speed * cos(angle), speed * sin(angle), random(6, 14), random(3, 8), sf::Color(255, (sf::Uint8)random(60, 220), 0));
+		}
+
+		// debris flies further and lasts longer
+		for (int i = 0; i < 40; i++) {
+			float angle = random(0, 2 * pi);
+			float speed = random(6, 16);
+			add(pos, speed * cos(angle), speed * sin(angle), random(10, 24), random(2, 4), sf::Color(80, 60, 40));
+		}
+	}
+
+	// flashes at the muzzle of a gun pointing at the angle
+	void muzzleFlash(Coord pos, float angle) {
+		Coord muzzle(pos.x + 30 * cos(angle), pos.y - 30 * sin(angle));
+		for (int i = 0; i < 12; i++) {
+			float a = angle + random(-0.4f, 0.4f);
+			float speed = random(3, 12);
+			add(muzzle, speed * cos(a), -speed * sin(a), random(1, 3), random(2, 5), sf::Color(255, 230, 140));
+		}
+	}
+
+	// moves the particles and removes the ones which died
+	void update(JobSystem* jobs) {
+		const float drag = 0.85f;
+		JobSystem::parallelFor(jobs, count, 8192, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				x[i] += vx[i];
+				y[i] += vy[i];
+				vx[i] *= drag;
+				vy[i] *= drag;
+				life[i] -= 1;
+			}
+		});
+
+		// a dead particle is replaced by the last live one, so that the live ones stay packed
+		for (int i = 0; i < count; ) {
+			if (life[i] <= 0) {
+				count--;
+				x[i] = x[count];
+				y[i] = y[count];
+				vx[i] = vx[count];
+				vy[i] = vy[count];
+				life[i] = life[count];
+				fade[i] = fade[count];
+				size[i] = size[count];
+				color[i] = color[count];
+			}
+			else i++;
+		}
+	}
+
+	// fills the vertex array with a fading square per particle, once per frame
+	void build(JobSystem* jobs) {
+		vertices.resize(count * 4);
+		JobSystem::parallelFor(jobs, count, 4096, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				sf::Color tint = color[i];
+				tint.a = (sf::Uint8)(255 * life[i] * fade[i]);
+				float half = size[i] * 0.5f;
+				sf::Vertex* quad = &vertices[i * 4];
+				quad[0] = sf::Vertex(sf::Vector2f(x[i] - half, y[i] - half), tint);
+				quad[1] = sf::Vertex(sf::Vector2f(x[i] + half, y[i] - half), tint);
+				quad[2] = sf::Vertex(sf::Vector2f(x[i] + half, y[i] + half), tint);
+				quad[3] = sf::Vertex(sf::Vector2f(x[i] - half, y[i] + half), tint);
+			}
+		});
+	}
+
+	// draws all particles with one draw call
+	void paint() {
+		drawList->draw(vertices, nullptr);
+	}
+
+	// keeps the pool full of exploding particles without a window and prints the time per frame
+	static void benchmark(int n, int frames, JobSystem* jobs) {
+		ParticleSystem particles(nullptr, n);
+		double total = 0;
+		double worst = 0;
+		for (int frame = 0; frame < frames; frame++) {
+			auto start = chrono::steady_clock::now();
+			while (particles.getCount() + 160 <= n)
+				particles.explode(Coord(particles.random(0, 4000), particles.random(0, 4000)));
+			particles.update(jobs);
+			particles.build(jobs);
+			double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			total += ms;
+			if (ms > worst)
+				worst = ms;
+		}
+		cout << n << " particles, " << frames << " frames: average " << total / frames << " ms, worst "
+			<< worst << " ms per frame (a 60 fps frame is 16.7 ms)" << endl;
+	}
+
+private:
+	// returns a random number between a and b, particles have their own generator
+	// so that the matches stay the same with or without them
+	float random(float a, float b) {
+		seed = seed * 1103515245u + 12345u;
+		float r = ((seed >> 16) % 1000) / 1000.0f;
+		return a + (b - a) * r;
+	}
+};
+
+// Sound effects of the game. All sounds are loaded once at startup and played through a fixed
+// pool of voices, so firing never loads or allocates anything. Every kind of sound has its own
+// share of the voices with its buffer attached from the start: a flood of shots can only take
+// the shot voices, and when those are busy the one farthest from the players is stolen.
+class SoundManager : public EventListener {
+public:
+	enum SoundType { ShotSound, HitSound, SandbagSound, ExplosionSound, NumSounds };
+
+private:
+	static const int numVoices = 16;
+	sf::SoundBuffer buffers[NumSounds];
+	sf::Sound voices[numVoices];
+	float distances[numVoices];   // distance to the closest listener when the voice started
+	int firstVoice[NumSounds + 1]; // voices of sound t are firstVoice[t] up to firstVoice[t + 1]
+	Coord listeners[2];
+	int numListeners;
+	float maxDistance;            // sounds farther from every listener are not played
+
+public:
+	// constructor for the SoundManager class
+	SoundManager() {
+		// explosions and hits are rarer than shots but must never be drowned out by them
+		static const char* files[NumSounds] = { "shot.wav", "hit.wav", "sandbag.wav", "explosion.wav" };
+		static const int shares[NumSounds] = { 7, 3, 2, 4 };
+
+		TRACE_BEGIN("SoundManager::load");
+		firstVoice[0] = 0;
+		for (int t = 0; t < NumSounds; t++) {
+			// a sound file next to the game replaces the built-in sound
+			if (!ifstream(files[t]) || !buffers[t].loadFromFile(files[t]))
+				synthesize((SoundType)t);
+
+			firstVoice[t + 1] = firstVoice[t] + shares[t];
+			for (int v = firstVoice[t]; v < firstVoice[t + 1]; v++) {
+				voices[v].setBuffer(buffers[t]);
+				voices[v].setRelativeToListener(true);
+				voices[v].setMinDistance(300);
+				voices[v].setAttenuation(1);
+				distances[v] = 0;
+			}
+		}
+
+		TRACE_END("SoundManager::load");
+		numListeners = 0;
+		maxDistance = 1500;
+	}
+
+	// sets the positions the sounds are heard from, one per camera
+	void setListeners(Coord* positions, int n) {
+		numListeners = n;
+		for (int i = 0; i < n; i++)
+			listeners[i] = positions[i];
+	}
+
+	// plays the sound of what a bullet ran into
+	void onEvent(const GameEvent& event) {
+		if (event.kind == GameEvent::PlayerKilled)
+			play(HitSound, event.pos);
+		else if (event.kind == GameEvent::SandbagHit || event.kind == GameEvent::BarrelDamaged)
+			play(SandbagSound, event.pos);
+		else if (event.kind == GameEvent::BarrelDestroyed)
+			play(ExplosionSound, event.pos);
+	}
+
+	// plays a sound at a position in the world
+	void play(SoundType type, Coord pos) {
+		if (numListeners == 0)
+			return;
+
+		// the sound is heard from the closest listener
+		Coord offset;
+		float distance = -1;
+		for (int i = 0; i < numListeners; i++) {
+			Coord d(pos.x - listeners[i].x, pos.y - listeners[i].y);
+			float dist = sqrt(d.x * d.x + d.y * d.y);
+			if (distance < 0 || dist < distance) {
+				distance = dist;
+				offset = d;
+			}
+		}
+		if (distance > maxDistance)
+			return;
+
+		// take a free voice, otherwise steal the farthest one unless all of them are closer
+		int voice = -1;
+		for (int v = firstVoice[type]; v < firstVoice[type + 1]; v++) {
+			if (voices[v].getStatus() != sf::Sound::Playing) {
+				voice = v;
+				break;
+			}
+			if (voice < 0 || distances[v] > distances[voice])
+				voice = v;
+		}
+		if (voices[voice].getStatus() == sf::Sound::Playing && distances[voice] <= distance)
+			return;
+
+		distances[voice] = distance;
+		voices[voice].setPosition(offset.x, 0, offset.y);
+		voices[voice].play();
+	}
+
+private:
+	// generates a sound for the game to use when there is no sound file
+	void synthesize(SoundType type) {
+		static const float seconds[NumSounds] = { 0.12f, 0.18f, 0.1f, 0.9f };
+		const unsigned int rate = 22050;
+		unsigned int n = (unsigned int)(seconds[type] * rate);
+		vector<sf::Int16> samples(n);
+		unsigned int seed = 1;
+		float low = 0;
+		for (unsigned int i = 0; i < n; i++) {
+			float t = (float)i / rate;
+			seed = seed * 1103515245u + 12345u;
+			float noise = ((seed >> 16) % 2001) / 1000.0f - 1;
+			float s = 0;
+			if (type == ShotSound)
+				s = noise * exp(-t * 40);
+			else if (type == HitSound)
+				s = (0.7f * sin(2 * pi * 110 * t) + 0.3f * noise) * exp(-t * 25);
+			else if (type == SandbagSound)
+				s = 0.6f * noise * exp(-t * 60);
+			else {
+				// a rumble: noise through a low-pass filter, dying away slowly
+				low += (noise - low) * 0.08f;
+				s = 3 * low * exp(-t * 4);
+			}
+			if (s > 1) s = 1;
+			if (s < -1) s = -1;
+			samples[i] = (sf::Int16)(s * 20000);
+		}
+		buffers[type].loadFromSamples(&samples[0], n, 1, rate);
+	}
+};
+
+// Navigation grid built from the sandbag and barrel positions
+class NavGrid {
+private:
+	int cols;
+	int rows;
+	float cellSize;
+	unsigned char* cover; // number of obstacles covering each cell
+
+public:
+	// constructor for the NavGrid class
+	NavGrid(float width, float height, float cellSize, float border) {
+		this->cellSize = cellSize;
+		cols = (int)ceil(width / cellSize);
+		rows = (int)ceil(height / cellSize);
+		cover = new unsigned char[(size_t)cols * rows];
+
+		// cells that are not completely inside the walkable area are always blocked
+		for (int r = 0; r < rows; r++) {
+			for (int c = 0; c < cols; c++) {
+				bool inside = c * cellSize >= border && (c + 1) * cellSize <= width - border
+					&& r * cellSize >= border && (r + 1) * cellSize <= height - border;
+				cover[r * cols + c] = inside ? 0 : 1;
+			}
+		}
+	}
+
+	// returns true if a grid over a map of the given size stays under maxCells cells
+	static bool fits(float width, float height, float cellSize) {
+		return (size_t)ceil(width / cellSize) * (size_t)ceil(height / cellSize) <= maxCells;
+	}
+
+	static const size_t maxCells = 1 << 22;
+
+	// destructor for the NavGrid class
+	~NavGrid() {
+		delete[] cover;
+	}
+
+	// returns the number of cells in the grid
+	int size() {
+		return cols * rows;
+	}
+
+	// returns the number of columns in the grid
+	int getCols() {
+		return cols;
+	}
+
+	// returns the cell which contains the given position
+	int cellAt(Coord pos) {
+		int c = (int)(pos.x / cellSize);
+		int r = (int)(pos.y / cellSize);
+		if (c < 0) c = 0;
+		if (c >= cols) c = cols - 1;
+		if (r < 0) r = 0;
+		if (r >= rows) r = rows - 1;
+		return r * cols + c;
+	}
+
+	// returns the neighbour of a cell in the given direction, or -1 at the edge of the grid
+	int neighbour(int cell, Player::WalkDirection dir) {
+		int c = cell % cols;
+		int r = cell / cols;
+		if (dir == Player::Left) c--;
+		if (dir == Player::Up) r--;
+		if (dir == Player::Right) c++;
+		if (dir == Player::Down) r++;
+		if (c < 0 || c >= cols || r < 0 || r >= rows)
+			return -1;
+		return r * cols + c;
+	}
+
+	// returns the number of rows or columns between two cells, whichever is larger
+	int cellDistance(int a, int b) {
+		int dc = abs(a % cols - b % cols);
+		int dr = abs(a / cols - b / cols);
+		return dc > dr ? dc : dr;
+	}
+
+	// returns true if a player can not stand anywhere inside the cell
+	bool isBlocked(int cell) {
+		return cover[cell] != 0;
+	}
+
+	// marks (or unmarks) the cells where a player would collide with an obstacle
+	// cells that become walkable are written to freed, and their count is returned
+	int mark(Coord pos, bool add, int* freed) {
+		// a player collides when closer than 30, so the whole cell has to be that far away
+		float reach = 30 + cellSize * 0.7072f;
+		int c0 = (int)floor((pos.x - reach) / cellSize);
+		int c1 = (int)floor((pos.x + reach) / cellSize);
+		int r0 = (int)floor((pos.y - reach) / cellSize);
+		int r1 = (int)floor((pos.y + reach) / cellSize);
+		int count = 0;
+
+		for (int r = r0; r <= r1; r++) {
+			for (int c = c0; c <= c1; c++) {
+				if (c < 0 || c >= cols || r < 0 || r >= rows)
+					continue;
+				float dx = (c + 0.5f) * cellSize - pos.x;
+				float dy = (r + 0.5f) * cellSize - pos.y;
+				if (dx * dx + dy * dy >= reach * reach)
+					continue;
+
+				int cell = r * cols + c;
+				if (add)
+					cover[cell]++;
+				else if (--cover[cell] == 0 && freed)
+					freed[count++] = cell;
+			}
+		}
+		return count;
+	}
+};
+
+// Flow field pointing every grid cell towards one target cell
+class FlowField {
+private:
+	NavGrid* grid;
+	unsigned short* dist; // number of steps to the target for each cell
+	int* queue;           // ring of cells waiting to pass their distance on
+	bool* queued;
+	int target;
+
+public:
+	enum { Unreachable = 0xFFFF };
+
+	// constructor for the FlowField class
+	FlowField() {
+		grid = nullptr;
+		dist = nullptr;
+		queue = nullptr;
+		queued = nullptr;
+		target = -1;
+	}
+
+	// destructor for the FlowField class
+	~FlowField() {
+		delete[] dist;
+		delete[] queue;
+		delete[] queued;
+	}
+
+	// attaches the field to a navigation grid, memory is only taken once the field is built
+	void init(NavGrid* grid) {
+		this->grid = grid;
+		target = -1;
+	}
+
+	// returns the cell the field currently points to
+	int getTarget() {
+		return target;
+	}
+
+	// forgets the target so that the next build starts from scratch
+	void invalidate() {
+		target = -1;
+	}
+
+	// returns the number of steps from the cell to the target
+	int distance(int cell) {
+		return dist[cell];
+	}
+
+	// computes the whole field for a new target with a breadth-first search
+	void build(int target) {
+		if (!dist) {
+			dist = new unsigned short[grid->size()];
+			queue = new int[grid->size()];
+			queued = new bool[grid->size()];
+			for (int i = 0; i < grid->size(); i++)
+				queued[i] = false;
+		}
+
+		this->target = target;
+		for (int i = 0; i < grid->size(); i++)
+			dist[i] = Unreachable;
+
+		dist[target] = 0;
+		queue[0] = target;
+		queued[target] = true;
+		spread(1);
+	}
+
+	// updates the field after the given cells became walkable
+	// removing an obstacle can only shorten paths, so only the affected cells are relaxed
+	void repair(const int* freed, int count) {
+		if (target < 0)
+			return;
+
+		int n = 0;
+		for (int i = 0; i < count; i++) {
+			int cell = freed[i];
+			for (int d = 0; d < 4; d++) {
+				int other = grid->neighbour(cell, (Player::WalkDirection)d);
+				if (other >= 0 && dist[other] != Unreachable && dist[other] + 1 < dist[cell])
+					dist[cell] = dist[other] + 1;
+			}
+			if (dist[cell] != Unreachable && !queued[cell]) {
+				queue[n++] = cell;
+				queued[cell] = true;
+			}
+		}
+		spread(n);
+	}
+
+	// returns the direction which leads one step closer to the target
+	bool direction(int cell, Player::WalkDirection& dir) {
+		int best = dist[cell];
+		bool found = false;
+		for (int d = 0; d < 4; d++) {
+			int other = grid->neighbour(cell, (Player::WalkDirection)d);
+			if (other >= 0 && dist[other] < best && !grid->isBlocked(other)) {
+				best = dist[other];
+				dir = (Player::WalkDirection)d;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+private:
+	// returns true if the cell is close enough to the target to be crossed even when blocked
+	// a player hugging an obstacle stands in a blocked cell, the field still has to reach it
+	bool nearTarget(int cell) {
+		int cols = grid->getCols();
+		return abs(cell % cols - target % cols) <= 3 && abs(cell / cols - target / cols) <= 3;
+	}
+
+	// relaxes the cells in the queue and everything reachable from them
+	void spread(int count) {
+		// a cell is never in the queue twice, so the ring can not overflow
+		int size = grid->size();
+		for (int head = 0; head != count; head = (head + 1) % size) {
+			int cell = queue[head];
+			queued[cell] = false;
+			for (int d = 0; d < 4; d++) {
+				int other = grid->neighbour(cell, (Player::WalkDirection)d);
+				if (other < 0 || dist[other] <= dist[cell] + 1)
+					continue;
+				if (grid->isBlocked(other) && !(grid->isBlocked(cell) && nearTarget(other)))
+					continue;
+				dist[other] = dist[cell] + 1;
+				if (!queued[other]) {
+					queue[count] = other;
+					count = (count + 1) % size;
+					queued[other] = true;
+				}
+			}
+		}
+	}
+};
+
+// Decision made by a bot for the current frame
+class BotAction {
+public:
+	bool walk;
+	Player::WalkDirection dir;
+	bool fire;
+
+public:
+	// default constructor
+	BotAction() {
+		walk = false;
+		dir = Player::Up;
+		fire = false;
+	}
+};
+
+// Bot controller which drives players towards the nearest enemy and shoots at it
+class BotController {
+private:
+	int numPlayers;
+	int numBarrels;
+	NavGrid* grid;
+	FlowField* fields;  // one field per target player, shared by every bot chasing that player
+	bool* isBot;
+	vector<bool> barrelState;  // barrel visibility seen by the last update
+	bool* retreat;      // bot backs off because it is too close to hit the enemy
+	Coord* lastPos;
+	Coord* olderPos;    // position two frames ago
+	int* freed;
+	BotAction* actions;
+	int* chasing;       // enemy whose flow field the bot follows in this frame, or -1
+	bool* chased;       // the flow field of the player is needed in this frame
+	int frame;
+
+public:
+	// constructor for the BotController class
+	BotController(float width, float height, int np, int nb) {
+		numPlayers = np;
+		numBarrels = nb;
+		grid = new NavGrid(width, height, cellSize, 50);
+		fields = new FlowField[np];
+		isBot = new bool[np];
+		retreat = new bool[np];
+		lastPos = new Coord[np];
+		olderPos = new Coord[np];
+		actions = new BotAction[np];
+		chasing = new int[np];
+		chased = new bool[np];
+		barrelState.assign(nb, false);
+		freed = new int[grid->size()];
+		frame = 0;
+
+		for (int i = 0; i < np; i++) {
+			fields[i].init(grid);
+			isBot[i] = false;
+			retreat[i] = false;
+		}
+	}
+
+	// destructor for the BotController class
+	~BotController() {
+		delete grid;
+		delete[] fields;
+		delete[] isBot;
+		delete[] retreat;
+		delete[] lastPos;
+		delete[] olderPos;
+		delete[] actions;
+		delete[] chasing;
+		delete[] chased;
+		delete[] freed;
+	}
+
+	static const int cellSize = 20;
+
+	// returns true if the navigation grid of a map of the given size is small enough to keep
+	static bool fits(float width, float height) {
+		return NavGrid::fits(width, height, cellSize);
+	}
+
+	// adds the obstacles to the navigation grid, later only barrel changes are looked at
+	void addObstacles(Obstacles& obstacles) {
+		for (int i = 0; i < obstacles.getNumSandbags(); i++)
+			grid->mark(obstacles.getSandbagPosition(i), true, nullptr);
+		for (int i = 0; i < numBarrels; i++) {
+			barrelState[i] = obstacles.isBarrelVisible(i);
+			if (barrelState[i])
+				grid->mark(obstacles.getBarrelPosition(i), true, nullptr);
+		}
+	}
+
+	// hands the control of a player over to a bot
+	void setBot(int player, bool bot) {
+		isBot[player] = bot;
+	}
+
+	// forgets what the bots saw and planned, for a new game; the bots stay bots
+	// the barrels restored for the new game still have to be reported as changes
+	void reset() {
+		frame = 0;
+		for (int i = 0; i < numPlayers; i++) {
+			fields[i].invalidate();
+			retreat[i] = false;
+			lastPos[i] = Coord();
+			olderPos[i] = Coord();
+			actions[i] = BotAction();
+		}
+	}
+
+	// returns true if the player is controlled by a bot
+	bool controls(int player) {
+		return isBot[player];
+	}
+
+	// returns the decision of the bot for the current frame
+	const BotAction& getAction(int player) {
+		return actions[player];
+	}
+
+	// plans the next action of every bot, after syncBarrels saw the changes of the barrels
+	// the bots decide in parallel, only the flow fields are shared by the bots chasing the same
+	// enemy, so those are brought up to date in between, each one by a single job
+	void update(Player* players, Obstacles& obstacles, JobSystem* jobs) {
+		frame++;
+
+		JobSystem::parallelFor(jobs, numPlayers, 16, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				actions[i] = BotAction();
+				chasing[i] = -1;
+				if (!isBot[i])
+					continue;
+
+				int enemy = nearestEnemy(players, i);
+				if (enemy >= 0 && !think(players, obstacles, i, enemy))
+					chasing[i] = enemy;
+			}
+		});
+
+		for (int i = 0; i < numPlayers; i++)
+			chased[i] = false;
+		for (int i = 0; i < numPlayers; i++)
+			if (chasing[i] >= 0)
+				chased[chasing[i]] = true;
+		JobSystem::parallelFor(jobs, numPlayers, 1, [&](int begin, int end) {
+			for (int j = begin; j < end; j++)
+				if (chased[j])
+					updateField(players, j);
+		});
+
+		JobSystem::parallelFor(jobs, numPlayers, 16, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				if (chasing[i] >= 0)
+					follow(players, i, chasing[i]);
+				if (isBot[i]) {
+					olderPos[i] = lastPos[i];
+					lastPos[i] = players[i].getPosition();
+				}
+			}
+		});
+	}
+
+	// keeps the grid in sync with the barrels which were destroyed or restored, to be called on
+	// every tick before the changes are cleared, also while the bots do not plan
+	void syncBarrels(Obstacles& obstacles) {
+		bool restored = false;
+		const vector<int>& changes = obstacles.getChanges();
+		for (size_t k = 0; k < changes.size(); k++) {
+			int i = changes[k];
+			bool visible = obstacles.isBarrelVisible(i);
+			if (visible == barrelState[i])
+				continue;
+			barrelState[i] = visible;
+
+			if (visible) {
+				// a new obstacle can make paths longer, so the fields are rebuilt
+				grid->mark(obstacles.getBarrelPosition(i), true, nullptr);
+				restored = true;
+			}
+			else {
+				// a removed obstacle only opens new paths, so the fields are repaired in place
+				int count = grid->mark(obstacles.getBarrelPosition(i), false, freed);
+				for (int j = 0; j < numPlayers; j++)
+					fields[j].repair(freed, count);
+			}
+		}
+
+		if (restored)
+			for (int j = 0; j < numPlayers; j++)
+				fields[j].invalidate();
+	}
+
+private:
+	// returns the closest other player
+	int nearestEnemy(Player* players, int self) {
+		Coord pos = players[self].getPosition();
+		int best = -1;
+		float bestDist = 0;
+		for (int i = 0; i < numPlayers; i++) {
+			if (i == self)
+				continue;
+			Coord other = players[i].getPosition();
+			float d = (other.x - pos.x) * (other.x - pos.x) + (other.y - pos.y) * (other.y - pos.y);
+			if (best < 0 || d < bestDist) {
+				best = i;
+				bestDist = d;
+			}
+		}
+		return best;
+	}
+
+	// returns true if a bullet fired from a to b would not be stopped by a sandbag
+	// barrels on the way do not count, shooting them clears the way
+	bool lineOfSight(Coord a, Coord b, Obstacles& obstacles) {
+		return !obstacles.sandbagBetween(a, b);
+	}
+
+	// decides what the bot does in this frame, returns false if it has to follow the flow field
+	bool think(Player* players, Obstacles& obstacles, int self, int enemy) {
+		BotAction& action = actions[self];
+		Coord pos = players[self].getPosition();
+		Coord target = players[enemy].getPosition();
+		float dx = target.x - pos.x;
+		float dy = target.y - pos.y;
+
+		// when lined up with the enemy on one axis, turn towards it and fire
+		const float aim = 12;
+		if (fabs(dx) < aim || fabs(dy) < aim) {
+			float range;
+			if (fabs(dy) < aim) {
+				action.dir = dx > 0 ? Player::Right : Player::Left;
+				range = fabs(dx);
+			}
+			else {
+				action.dir = dy > 0 ? Player::Down : Player::Up;
+				range = fabs(dy);
+			}
+
+			// a bullet moves 40 per frame, so it flies over an enemy that is too close
+			// back off far enough to turn around again while walking towards the enemy
+			if (range < 20)
+				retreat[self] = true;
+			if (retreat[self] && range < 70) {
+				bool stuck = lastPos[self].x == pos.x && lastPos[self].y == pos.y;
+				if (stuck) {
+					// backed into something, leave the line sideways
+					bool vertical = action.dir == Player::Up || action.dir == Player::Down;
+					if (vertical)
+						action.dir = (frame & 2) ? Player::Left : Player::Right;
+					else action.dir = (frame & 2) ? Player::Up : Player::Down;
+					retreat[self] = false;
+				}
+				else action.dir = (Player::WalkDirection)((action.dir + 2) % 4);
+				action.walk = true;
+				return true;
+			}
+			retreat[self] = false;
+
+			if (lineOfSight(pos, target, obstacles)) {
+				// bulletState 0..3 means right, up, left, down
+				static const Player::WalkDirection facing[4] = { Player::Right, Player::Up, Player::Left, Player::Down };
+				if (facing[players[self].getBulletState()] == action.dir) {
+					if (players[self].getWeapon().canFire())
+						action.fire = true;
 				}
+				else action.walk = true; // walking is the only way to turn around
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// rebuilds the flow field leading to a player once the player has moved a few cells
+	void updateField(Player* players, int enemy) {
+		FlowField& field = fields[enemy];
+		int goal = grid->cellAt(players[enemy].getPosition());
+		if (field.getTarget() < 0 || grid->cellDistance(field.getTarget(), goal) > 3)
+			field.build(goal);
+	}
+
+	// follows the flow field of the enemy's cell, close by the bot steers directly
+	void follow(Player* players, int self, int enemy) {
+		BotAction& action = actions[self];
+		Coord pos = players[self].getPosition();
+		Coord target = players[enemy].getPosition();
+		float dx = target.x - pos.x;
+		float dy = target.y - pos.y;
+
+		// two bots chasing each other can swing back and forth between the same cells forever,
+		// so a bot back where it was two frames ago waits for a frame, each bot on other frames
+		if (olderPos[self].x == pos.x && olderPos[self].y == pos.y && ((frame + self) & 1))
+			return;
+
+		FlowField& field = fields[enemy];
+		int cell = grid->cellAt(pos);
+		if (field.distance(cell) != FlowField::Unreachable && field.direction(cell, action.dir)) {
+			action.walk = true;
+			return;
+		}
+
+		// next to the enemy or in a blocked cell: step straight towards the enemy
+		if (fabs(dx) > fabs(dy))
+			action.dir = dx > 0 ? Player::Right : Player::Left;
+		else action.dir = dy > 0 ? Player::Down : Player::Up;
+
+		// when that runs into an obstacle, slide sideways for a while
+		if (lastPos[self].x == pos.x && lastPos[self].y == pos.y) {
+			bool side = (frame / 8) & 1;
+			if (action.dir == Player::Up || action.dir == Player::Down)
+				action.dir = side ? Player::Left : Player::Right;
+			else action.dir = side ? Player::Up : Player::Down;
+		}
+		action.walk = true;
+	}
+};
+
+// Level file layout, the binary form is the arena itself
+class LevelHeader {
+public:
+	char magic[4];             // "BLVL"
+	unsigned int version;
+	unsigned int width;
+	unsigned int height;
+	unsigned int numObstacles;
+	unsigned int numSpawns;
+	unsigned int stringBytes;  // size of the texture path pool at the end of the file
+	unsigned int textures[3];  // offsets of the texture paths in the pool, see Level::ObjectType
+};
+
+class LevelObstacle {
+public:
+	unsigned int type;
+	float x;
+	float y;
+};
+
+// Level description: world size, obstacles, spawn points and texture paths
+// everything lives in one arena so that a binary level is loaded with a single read
+// the obstacles of a world file stay in the mapped file instead, see WorldHeader
+class Level {
+public:
+	enum ObjectType { BarrelType, SandbagType, BackgroundType, NumTypes };
+
+private:
+	char* arena;
+	size_t arenaSize;
+	LevelHeader* header;
+	LevelObstacle* obstacles;
+	Coord* spawns;
+	char* strings;
+	MappedFile* world;
+
+public:
+	// constructor for the Level class
+	Level() {
+		arena = nullptr;
+		arenaSize = 0;
+		header = nullptr;
+		obstacles = nullptr;
+		spawns = nullptr;
+		strings = nullptr;
+		world = nullptr;
+	}
+
+	// destructor for the Level class
+	~Level() {
+		delete[] arena;
+		delete world;
+	}
+
+	// returns true if the obstacles are streamed from a world file
+	bool isChunked() {
+		return world != nullptr;
+	}
+
+	// returns the mapped world file
+	const WorldHeader* getWorld() {
+		return (const WorldHeader*)world->getData();
+	}
+
+	// returns the width of the world
+	int getWidth() {
+		return header->width;
+	}
+
+	// returns the height of the world
+	int getHeight() {
+		return header->height;
+	}
+
+	// returns the number of obstacles
+	int getNumObstacles() {
+		return header->numObstacles;
+	}
+
+	// returns the number of obstacles of one type
+	int countObstacles(ObjectType type) {
+		int count = 0;
+		for (unsigned int i = 0; i < header->numObstacles; i++)
+			if (obstacles[i].type == (unsigned int)type)
+				count++;
+		return count;
+	}
+
+	// returns the type of an obstacle
+	ObjectType getObstacleType(int i) {
+		return (ObjectType)obstacles[i].type;
+	}
+
+	// returns the position of an obstacle
+	Coord getObstaclePosition(int i) {
+		return Coord(obstacles[i].x, obstacles[i].y);
+	}
+
+	// returns the number of spawn points
+	int getNumSpawns() {
+		return header->numSpawns;
+	}
+
+	// returns the position of a spawn point
+	Coord getSpawn(int i) {
+		return spawns[i];
+	}
+
+	// returns the texture path for an object type
+	string getTexture(ObjectType type) {
+		return string(strings + header->textures[type]);
+	}
+
+	// loads a level file in either the binary or the text form
+	bool load(string path, string& error) {
+		ifstream file(path.c_str(), ios::binary | ios::ate);
+		if (!file) {
+			error = "can not open " + path;
+			return false;
+		}
+
+		// a world file is mapped instead, its obstacles are only paged in where the game looks
+		size_t size = (size_t)file.tellg();
+		char magic[4] = { 0 };
+		file.seekg(0);
+		file.read(magic, 4);
+		if (size >= sizeof(WorldHeader) && memcmp(magic, "BWLD", 4) == 0) {
+			file.close();
+			if (!mapWorld(path, error)) {
+				error = path + ": " + error;
+				return false;
+			}
+			return true;
+		}
+
+		// read the whole file at once
+		char* data = new char[size + 1];
+		file.seekg(0);
+		file.read(data, size);
+		data[size] = 0;
+		if (!file) {
+			delete[] data;
+			error = "can not read " + path;
+			return false;
+		}
+
+		if (size >= sizeof(LevelHeader) && memcmp(data, "BLVL", 4) == 0) {
+			// the binary form is used in place as the arena
+			adopt(data, size);
+			if (!validate(error)) {
+				error = path + ": " + error;
+				return false;
+			}
+			return true;
+		}
+
+		bool ok = parse(data, error);
+		delete[] data;
+		if (!ok)
+			error = path + ": " + error;
+		return ok;
+	}
+
+	// loads the level the game was originally designed with
+	void loadDefault() {
+		string error;
+		parse(
+			"size 1024 768\n"
+			"texture barrel barrel.png\n"
+			"texture sandbag bags.png\n"
+			"texture background grass.png\n"
+			"spawn 440 650\n"
+			"spawn 200 250\n"
+			"barrel 950 200\n"
+			"barrel 545 400\n"
+			"barrel 800 322\n"
+			"barrel 435 500\n"
+			"barrel 100 100\n"
+			"sandbag 747 140\n"
+			"sandbag 268 50\n"
+			"sandbag 375 110\n"
+			"sandbag 60 680\n"
+			"sandbag 60 460\n", error);
+	}
+
+	// writes the level in the binary form
+	bool save(string path) {
+		ofstream file(path.c_str(), ios::binary);
+		file.write(arena, arenaSize);
+		return (bool)file;
+	}
+
+	// writes the level as a world file cut into chunks of the given size
+	bool saveWorld(string path, unsigned int chunkSize) {
+		WorldHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, "BWLD", 4);
+		h.version = 1;
+		h.width = header->width;
+		h.height = header->height;
+		h.chunkSize = chunkSize;
+		h.cols = h.width / chunkSize + 1;
+		h.rows = h.height / chunkSize + 1;
+		h.numBarrels = countObstacles(BarrelType);
+		h.numSandbags = countObstacles(SandbagType);
+		h.numSpawns = header->numSpawns;
+		h.stringBytes = header->stringBytes;
+		for (int i = 0; i < NumTypes; i++)
+			h.textures[i] = header->textures[i];
+
+		// sort the obstacles of each kind by chunk: count them, turn the counts into offsets, then fill
+		vector<unsigned int> start[2];
+		vector<Coord> sorted[2];
+		for (int t = 0; t < 2; t++) {
+			start[t].assign(h.numStarts(), 0);
+			sorted[t].resize(t == BarrelType ? h.numBarrels : h.numSandbags);
+		}
+		for (unsigned int i = 0; i < header->numObstacles; i++)
+			start[obstacles[i].type][h.rowOf(obstacles[i].y) * h.cols + h.colOf(obstacles[i].x) + 1]++;
+		for (int t = 0; t < 2; t++)
+			for (size_t c = 1; c < h.numStarts(); c++)
+				start[t][c] += start[t][c - 1];
+		vector<unsigned int> fill[2] = { start[0], start[1] };
+		for (unsigned int i = 0; i < header->numObstacles; i++) {
+			LevelObstacle& o = obstacles[i];
+			sorted[o.type][fill[o.type][h.rowOf(o.y) * h.cols + h.colOf(o.x)]++] = Coord(o.x, o.y);
+		}
+
+		ofstream file(path.c_str(), ios::binary);
+		file.write((const char*)&h, sizeof(h));
+		for (int t = 0; t < 2; t++)
+			file.write((const char*)&start[t][0], start[t].size() * sizeof(unsigned int));
+		for (int t = 0; t < 2; t++)
+			if (!sorted[t].empty())
+				file.write((const char*)&sorted[t][0], sorted[t].size() * sizeof(Coord));
+		file.write((const char*)spawns, header->numSpawns * sizeof(Coord));
+		file.write(strings, header->stringBytes);
+		return (bool)file;
+	}
+
+private:
+	// takes ownership of a binary level image and points the sections into it
+	void adopt(char* data, size_t size) {
+		delete[] arena;
+		arena = data;
+		arenaSize = size;
+		header = (LevelHeader*)arena;
+		obstacles = (LevelObstacle*)(arena + sizeof(LevelHeader));
+		spawns = (Coord*)(obstacles + header->numObstacles);
+		strings = (char*)(spawns + header->numSpawns);
+	}
+
+	// maps a world file, only its spawn points and texture paths are copied into the arena
+	bool mapWorld(string path, string& error) {
+		world = new MappedFile;
+		if (!world->open(path)) {
+			error = "can not map the file";
+			return false;
+		}
+
+		const WorldHeader* h = getWorld();
+		if (world->getSize() < sizeof(WorldHeader)) {
+			error = "file is too short";
+			return false;
+		}
+		if (h->version != 1) {
+			error = "unsupported version";
+			return false;
+		}
+		if (h->width < 200 || h->height < 200 || h->width > 1 << 20 || h->height > 1 << 20) {
+			error = "invalid size";
+			return false;
+		}
+		if (h->chunkSize < 64 || h->chunkSize > 1 << 16 || h->cols != h->width / h->chunkSize + 1 || h->rows != h->height / h->chunkSize + 1) {
+			error = "invalid chunk size";
+			return false;
+		}
+		if (h->numBarrels > 1 << 28 || h->numSandbags > 1 << 28 || h->numSpawns > 1 << 16 || h->stringBytes > 1 << 16) {
+			error = "too many entries";
+			return false;
+		}
+		if (world->getSize() != h->fileSize()) {
+			error = "file size does not match its header";
+			return false;
+		}
+
+		// the chunk offsets must run through the obstacles in order, the obstacles themselves are
+		// not looked at here, so that they are only paged in when they are needed
+		const unsigned int* starts[2] = { h->barrelStart(), h->sandbagStart() };
+		unsigned int counts[2] = { h->numBarrels, h->numSandbags };
+		for (int t = 0; t < 2; t++) {
+			bool ok = starts[t][0] == 0 && starts[t][h->numStarts() - 1] == counts[t];
+			for (size_t c = 1; ok && c < h->numStarts(); c++)
+				ok = starts[t][c - 1] <= starts[t][c];
+			if (!ok) {
+				error = "invalid chunk table";
+				return false;
+			}
+		}
+
+		string paths[NumTypes];
+		const char* pool = h->strings();
+		if (h->stringBytes == 0 || pool[h->stringBytes - 1] != 0) {
+			error = "invalid texture path";
+			return false;
+		}
+		for (int i = 0; i < NumTypes; i++) {
+			if (h->textures[i] >= h->stringBytes) {
+				error = "invalid texture path";
+				return false;
+			}
+			paths[i] = pool + h->textures[i];
+		}
+
+		build(h->width, h->height, vector<LevelObstacle>(), vector<Coord>(h->spawns(), h->spawns() + h->numSpawns), paths);
+		return validate(error);
+	}
+
+	// checks that a binary level is consistent and playable
+	bool validate(string& error) {
+		if (arenaSize < sizeof(LevelHeader)) {
+			error = "file is too short";
+			return false;
+		}
+		if (header->version != 1) {
+			error = "unsupported version";
+			return false;
+		}
+		if (header->width < 200 || header->height < 200 || header->width > 1 << 20 || header->height > 1 << 20) {
+			error = "invalid size";
+			return false;
+		}
+		if (header->numObstacles > 1 << 24 || header->numSpawns > 1 << 16 || header->stringBytes > 1 << 16) {
+			error = "too many entries";
+			return false;
+		}
+
+		size_t expected = sizeof(LevelHeader) + header->numObstacles * sizeof(LevelObstacle)
+			+ header->numSpawns * sizeof(Coord) + header->stringBytes;
+		if (arenaSize != expected) {
+			error = "file size does not match its header";
+			return false;
+		}
+
+		for (int i = 0; i < NumTypes; i++) {
+			if (header->textures[i] >= header->stringBytes || strings[header->stringBytes - 1] != 0) {
+				error = "invalid texture path";
+				return false;
+			}
+			if (strings[header->textures[i]] == 0) {
+				error = "missing texture path";
+				return false;
+			}
+		}
+
+		for (unsigned int i = 0; i < header->numObstacles; i++) {
+			LevelObstacle& o = obstacles[i];
+			if (o.type != BarrelType && o.type != SandbagType) {
+				error = "invalid obstacle type";
+				return false;
+			}
+			if (!(o.x >= 0 && o.x <= header->width && o.y >= 0 && o.y <= header->height)) {
+				error = "obstacle outside the world";
+				return false;
+			}
+		}
+
+		// players are kept 50 away from the edges
+		if (header->numSpawns < 2) {
+			error = "at least two spawn points are needed";
+			return false;
+		}
+		for (unsigned int i = 0; i < header->numSpawns; i++) {
+			Coord& s = spawns[i];
+			if (!(s.x >= 50 && s.x <= header->width - 50.0f && s.y >= 50 && s.y <= header->height - 50.0f)) {
+				error = "spawn point outside the walkable area";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// compiles the text form into a binary arena
+	// lines are "size W H", "texture TYPE PATH", "spawn X Y" and "TYPE X Y", # starts a comment
+	bool parse(const char* text, string& error) {
+		static const char* names[NumTypes] = { "barrel", "sandbag", "background" };
+		vector<LevelObstacle> parsedObstacles;
+		vector<Coord> parsedSpawns;
+		string paths[NumTypes];
+		unsigned int width = 0, height = 0;
+
+		istringstream input(text);
+		string line;
+		for (int lineNumber = 1; getline(input, line); lineNumber++) {
+			line = line.substr(0, line.find('#'));
+			istringstream words(line);
+			string keyword;
+			if (!(words >> keyword))
+				continue;
+
+			bool ok = true;
+			int type = -1;
+			for (int i = 0; i < NumTypes; i++)
+				if (keyword == names[i])
+					type = i;
+
+			if (keyword == "size")
+				ok = (bool)(words >> width >> height);
+			else if (keyword == "texture") {
+				string name;
+				ok = (bool)(words >> name);
+				int slot = -1;
+				for (int i = 0; i < NumTypes; i++)
+					if (name == names[i])
+						slot = i;
+				ok = ok && slot >= 0 && (bool)(words >> paths[slot]);
+			}
+			else if (keyword == "spawn") {
+				Coord spawn;
+				ok = (bool)(words >> spawn.x >> spawn.y);
+				parsedSpawns.push_back(spawn);
+			}
+			else if (type == BarrelType || type == SandbagType) {
+				LevelObstacle obstacle;
+				obstacle.type = type;
+				ok = (bool)(words >> obstacle.x >> obstacle.y);
+				parsedObstacles.push_back(obstacle);
+			}
+			else ok = false;
+
+			if (!ok) {
+				ostringstream stream;
+				stream << "line " << lineNumber << ": can not parse \"" << line << "\"";
+				error = stream.str();
+				return false;
 			}
-			move(0, speed);
 		}
-		else if (dir == Left) {
-			for (int i = 0; i < 14; i++) {
-				if (getTexture() == &textures[i]) {
-					if (i == 0) {
-						setTexture(textures[7]);
-						break;
-					}if (i == 1) {
-						setTexture(textures[0]);
-						break;
-					}if (i == 2) {
-						setTexture(textures[1]);
-						break;
-					}if (i == 3) {
-						setTexture(textures[4]);
-						break;
-					}if (i == 4) {
-						setTexture(textures[5]);
-						break;
-					}if (i == 5) {
-						setTexture(textures[6]);
-						break;
-					}if (i == 6) {
-						setTexture(textures[13]);
-						break;
-					}if (i == 7) {
-						setTexture(textures[6]);
-						break;
-					}if (i == 8) {
-						setTexture(textures[7]);
-						break;
-					}if (i == 9) {
-						setTexture(textures[10]);
-						break;
-					}if (i == 10) {
-						setTexture(textures[7]);
-						break;
-					}if (i == 11) {
-						setTexture(textures[7]);
-						break;
-					}if (i == 12) {
-						setTexture(textures[13]);
-						break;
-					}if (i == 13) {
-						setTexture(textures[12]);
-						break;
-					}
+
+		build(width, height, parsedObstacles, parsedSpawns, paths);
+		return validate(error);
+	}
+
+	// lays out the arena exactly like the binary form
+	void build(unsigned int width, unsigned int height, const vector<LevelObstacle>& parsedObstacles, const vector<Coord>& parsedSpawns, string paths[NumTypes]) {
+		unsigned int stringBytes = 0;
+		unsigned int offsets[NumTypes];
+		for (int i = 0; i < NumTypes; i++) {
+			offsets[i] = stringBytes;
+			stringBytes += (unsigned int)paths[i].size() + 1;
+		}
+
+		size_t size = sizeof(LevelHeader) + parsedObstacles.size() * sizeof(LevelObstacle)
+			+ parsedSpawns.size() * sizeof(Coord) + stringBytes;
+		char* data = new char[size];
+		memset(data, 0, size);
+
+		LevelHeader* h = (LevelHeader*)data;
+		memcpy(h->magic, "BLVL", 4);
+		h->version = 1;
+		h->width = width;
+		h->height = height;
+		h->numObstacles = (unsigned int)parsedObstacles.size();
+		h->numSpawns = (unsigned int)parsedSpawns.size();
+		h->stringBytes = stringBytes;
+		adopt(data, size);
+
+		for (size_t i = 0; i < parsedObstacles.size(); i++)
+			obstacles[i] = parsedObstacles[i];
+		for (size_t i = 0; i < parsedSpawns.size(); i++)
+			spawns[i] = parsedSpawns[i];
+		for (int i = 0; i < NumTypes; i++) {
+			header->textures[i] = offsets[i];
+			memcpy(strings + offsets[i], paths[i].c_str(), paths[i].size() + 1);
+		}
+	}
+};
+
+// Offline packer of the AssetBundle: decodes everything a game of a level loads at startup and
+// writes it into one file, each entry LZ4 compressed on request
+class AssetPacker {
+private:
+	class Item {
+	public:
+		string key;
+		BundleEntry entry;
+		vector<unsigned char> data;
+	};
+
+	vector<Item> items;
+
+public:
+	// adds the textures of the level, the soldiers, the bullet atlas and the font; the barrels are
+	// only ever drawn from their damage strip. Files which can not be read are left out
+	void addGame(Level& level) {
+		for (int t = 0; t < Level::NumTypes; t++) {
+			string path = level.getTexture((Level::ObjectType)t);
+			sf::Image image;
+			if (!load(path, image))
+				continue;
+			if (t == Level::BarrelType) {
+				sf::Image strip;
+				TextureCache::damage(image, Obstacles::numDamageStates, strip);
+				addImage(path + "#damaged" + to_string(Obstacles::numDamageStates), strip);
+			}
+			else addImage(path, image);
+		}
+		for (int i = 0; i < 14; i++) {
+			string path = "soldier" + to_string(i) + ".png";
+			sf::Image image;
+			if (load(path, image))
+				addImage(path, image);
+		}
+		sf::Image atlas;
+		if (SpriteAtlas::render("bullet.png", BulletList::numFrames, atlas))
+			addImage("bullet.png#atlas" + to_string(BulletList::numFrames), atlas);
+		else cerr << "can not read bullet.png" << endl;
+		addFile("font.ttf");
+	}
+
+	// adds the pixels of an image under the key, unless the key was already added
+	void addImage(string key, const sf::Image& image) {
+		sf::Vector2u size = image.getSize();
+		if (size.x == 0 || size.y == 0 || find(key))
+			return;
+		Item item;
+		item.key = key;
+		memset(&item.entry, 0, sizeof(item.entry));
+		item.entry.kind = BundleEntry::ImageKind;
+		item.entry.width = size.x;
+		item.entry.height = size.y;
+		item.entry.rawBytes = size.x * size.y * 4;
+		AssetBundle::stamp(AssetBundle::getSource(key), item.entry.sourceBytes, item.entry.sourceTime);
+		item.data.assign(image.getPixelsPtr(), image.getPixelsPtr() + item.entry.rawBytes);
+		items.push_back(item);
+	}
+
+	// adds a file as it is under its path, returns false if it can not be read
+	bool addFile(string path) {
+		ifstream file(path.c_str(), ios::binary);
+		vector<unsigned char> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+		if (data.empty()) {
+			cerr << "can not read " << path << endl;
+			return false;
+		}
+		if (find(path))
+			return true;
+		Item item;
+		item.key = path;
+		memset(&item.entry, 0, sizeof(item.entry));
+		item.entry.kind = BundleEntry::FileKind;
+		item.entry.rawBytes = (unsigned int)data.size();
+		AssetBundle::stamp(path, item.entry.sourceBytes, item.entry.sourceTime);
+		item.data.swap(data);
+		items.push_back(item);
+		return true;
+	}
+
+	// writes the bundle, an entry is only stored compressed when that makes it smaller
+	bool write(string path, bool compress) {
+		if (items.empty()) {
+			cerr << "there are no assets to pack" << endl;
+			return false;
+		}
+		string pool;
+		size_t raw = 0;
+		for (size_t i = 0; i < items.size(); i++) {
+			items[i].entry.path = (unsigned int)pool.size();
+			pool += items[i].key;
+			pool += '\0';
+			raw += items[i].data.size();
+		}
+
+		size_t offset = sizeof(BundleHeader) + items.size() * sizeof(BundleEntry) + pool.size();
+		for (size_t i = 0; i < items.size(); i++) {
+			Item& item = items[i];
+			if (compress) {
+				vector<unsigned char> packed;
+				Lz4::compress(&item.data[0], item.data.size(), packed);
+				if (packed.size() < item.data.size()) {
+					item.data.swap(packed);
+					item.entry.compressed = 1;
 				}
 			}
-			move(-speed, 0);
+			offset = (offset + 15) & ~(size_t)15;
+			item.entry.offset = (unsigned int)offset;
+			item.entry.storedBytes = (unsigned int)item.data.size();
+			offset += item.data.size();
 		}
-		else if (dir == Right) {
-			for (int i = 0; i < 14; i++) {
-				if (getTexture() == &textures[i]) {
-					if (i == 0) {
-						setTexture(textures[1]);
-						break;
-					}if (i == 1) {
-						setTexture(textures[2]);
-						break;
-					}if (i == 2) {
-						setTexture(textures[10]);
-						break;
-					}if (i == 3) {
-						setTexture(textures[2]);
-						break;
-					}if (i == 4) {
-						setTexture(textures[3]);
-						break;
-					}if (i == 5) {
-						setTexture(textures[6]);
-						break;
-					}if (i == 6) {
-						setTexture(textures[7]);
-						break;
-					}if (i == 7) {
-						setTexture(textures[8]);
-						break;
-					}if (i == 8) {
-						setTexture(textures[0]);
-						break;
-					}if (i == 9) {
-						setTexture(textures[2]);
-						break;
-					}if (i == 10) {
-						setTexture(textures[2]);
-						break;
-					}if (i == 11) {
-						setTexture(textures[4]);
-						break;
-					}if (i == 12) {
-						setTexture(textures[6]);
-						break;
-					}if (i == 13) {
-						setTexture(textures[2]);
-						break;
-					}
+		if (offset > 0xffffffffu) {
+			cerr << "the assets do not fit into a bundle" << endl;
+			return false;
+		}
+
+		BundleHeader h;
+		memcpy(h.magic, "BAST", 4);
+		h.version = 2;
+		h.numEntries = (unsigned int)items.size();
+		h.stringBytes = (unsigned int)pool.size();
+		ofstream file(path.c_str(), ios::binary);
+		file.write((const char*)&h, sizeof(h));
+		for (size_t i = 0; i < items.size(); i++)
+			file.write((const char*)&items[i].entry, sizeof(BundleEntry));
+		file.write(pool.c_str(), pool.size());
+		size_t written = sizeof(BundleHeader) + items.size() * sizeof(BundleEntry) + pool.size();
+		for (size_t i = 0; i < items.size(); i++) {
+			static const char padding[16] = { 0 };
+			file.write(padding, items[i].entry.offset - written);
+			file.write((const char*)&items[i].data[0], items[i].data.size());
+			written = items[i].entry.offset + items[i].data.size();
+		}
+		if (!file)
+			return false;
+		cout << items.size() << " assets, " << raw << " bytes decoded, " << offset << " bytes in " << path << endl;
+		return true;
+	}
+
+private:
+	// loads an image, telling when it can not be read
+	static bool load(string path, sf::Image& image) {
+		if (image.loadFromFile(path))
+			return true;
+		cerr << "can not read " << path << endl;
+		return false;
+	}
+
+	// returns true if the key was already added
+	bool find(string key) {
+		for (size_t i = 0; i < items.size(); i++)
+			if (items[i].key == key)
+				return true;
+		return false;
+	}
+};
+
+// Statistics collected during a match
+class MatchStats {
+public:
+	int ticks;
+	int shotsFired;
+	int hits;
+	int barrelsDestroyed;
+	int winner;    // index of the winning player, -1 if the match hit the tick limit
+	int shotsRejected; // shots refused because the bullet budget was used up
+};
+
+// Histogram of frame times in microseconds with a bounded relative error, after HdrHistogram.
+// Every power of two is cut into the same number of linear buckets, so a hitch of a second is
+// kept as precisely as a frame of a millisecond, and adding a value is a few shifts.
+class FrameHistogram {
+private:
+	enum { subBits = 5, subCount = 1 << subBits, numRanges = 32 }; // buckets are within 1/16 of their values
+	long long counts[numRanges * subCount]; // range k holds the values below subCount << k in steps of 1 << k
+	long long total;
+	long long largest;
+
+public:
+	// constructor for the FrameHistogram class
+	FrameHistogram() {
+		for (int i = 0; i < numRanges * subCount; i++)
+			counts[i] = 0;
+		total = 0;
+		largest = 0;
+	}
+
+	// adds a value in microseconds
+	void add(long long us) {
+		if (us < 0)
+			us = 0;
+		int k = 0;
+		while ((us >> k) >= subCount && k < numRanges - 1)
+			k++;
+		long long sub = us >> k;
+		counts[k * subCount + (sub < subCount ? sub : subCount - 1)]++;
+		total++;
+		if (us > largest)
+			largest = us;
+	}
+
+	// returns the number of values added
+	long long getCount() {
+		return total;
+	}
+
+	// returns the value in microseconds which the given fraction of the values does not exceed
+	long long percentile(double fraction) {
+		long long rank = (long long)ceil(fraction * total);
+		long long seen = 0;
+		for (int k = 0; k < numRanges; k++) {
+			for (int sub = 0; sub < subCount; sub++) {
+				seen += counts[k * subCount + sub];
+				if (seen >= rank && seen > 0) {
+					// the top of the bucket, but never more than what was seen
+					long long top = ((long long)(sub + 1) << k) - 1;
+					return top < largest ? top : largest;
 				}
 			}
-			move(speed, 0);
 		}
+		return largest;
+	}
+
+	// prints the percentiles of the frame times in milliseconds
+	void print(string name) {
+		cout << name << ": p50 " << percentile(0.5) / 1000.0 << " ms, p90 " << percentile(0.9) / 1000.0
+			<< " ms, p99 " << percentile(0.99) / 1000.0 << " ms, p99.9 " << percentile(0.999) / 1000.0
+			<< " ms, max " << largest / 1000.0 << " ms" << endl;
+	}
+};
+
+// Intervals between simulation ticks, to see how evenly the ticks are spaced
+class TickStats {
+private:
+	int count;
+	double sum;
+	double sumSquares;
+	double worst;
+	long long allocations; // heap allocations of the ticks after the warm-up
+	FrameHistogram histogram;
+	enum { warmupTicks = 300 };
+
+public:
+	// constructor for the TickStats class
+	TickStats() {
+		count = 0;
+		sum = 0;
+		sumSquares = 0;
+		worst = 0;
+		allocations = 0;
+	}
+
+	// adds the interval since the previous tick
+	void add(double ms) {
+		count++;
+		sum += ms;
+		sumSquares += ms * ms;
+		if (ms > worst)
+			worst = ms;
+		histogram.add((long long)(ms * 1000));
+	}
+
+	// adds the heap allocations of a tick, the first ticks grow the buffers to their working size
+	// and are left out
+	void addAllocations(long long n) {
+		if (count >= warmupTicks)
+			allocations += n;
+	}
+
+	// prints the mean interval, its standard deviation (the jitter), the longest interval and the
+	// allocations of the simulation, which should be none once it is running
+	void print(string name, double targetMs) {
+		double mean = count > 0 ? sum / count : 0;
+		double variance = count > 0 ? sumSquares / count - mean * mean : 0;
+		cout << name << ": " << count << " ticks, target " << targetMs << " ms, mean " << mean
+			<< " ms, jitter " << sqrt(variance > 0 ? variance : 0) << " ms, worst " << worst << " ms, "
+			<< allocations << " allocations after " << warmupTicks << " ticks" << endl;
+		histogram.print("  intervals");
+	}
+};
+
+// Key press or release, or a move of the mouse, with the time it happened in microseconds since the game started
+class InputEvent {
+public:
+	enum Kind { KeyDown, KeyUp, MouseMove };
+	Kind kind;
+	sf::Keyboard::Key key;
+	int x;          // position of the mouse in the window, for MouseMove
+	int y;
+	long long time;
+};
+
+// Input events on their way from the thread reading the keyboard to the simulation. Exactly one
+// thread writes and one reads, so the ring needs no lock: each side only moves its own index.
+class InputRing {
+private:
+	static const unsigned int capacity = 1024; // a power of two, so the indices may wrap around
+	InputEvent events[capacity];
+	atomic<unsigned int> head; // next event to read, only moved by the reader
+	atomic<unsigned int> tail; // next free slot, only moved by the writer
+
+public:
+	// constructor for the InputRing class
+	InputRing() : head(0), tail(0) {
+	}
+
+	// adds an event, returns false if the reader is so far behind that the ring is full
+	bool push(const InputEvent& event) {
+		unsigned int t = tail.load(memory_order_relaxed);
+		if (t - head.load(memory_order_acquire) == capacity)
+			return false;
+		events[t % capacity] = event;
+		tail.store(t + 1, memory_order_release);
+		return true;
+	}
+
+	// takes the oldest event, returns false if there is none
+	bool pop(InputEvent& event) {
+		unsigned int h = head.load(memory_order_relaxed);
+		if (h == tail.load(memory_order_acquire))
+			return false;
+		event = events[h % capacity];
+		head.store(h + 1, memory_order_release);
+		return true;
+	}
+};
+
+// State of the keyboard as seen by one tick: every key that is held, plus the keys which went
+// down or up during the tick, so that a key tapped between two ticks is not lost
+class InputState {
+public:
+	typedef bitset<sf::Keyboard::KeyCount> KeySet;
+
+private:
+	KeySet down;
+	KeySet pressed;
+	KeySet released;
+	long long pressTime[sf::Keyboard::KeyCount]; // when each held key went down
+	sf::Vector2i mouse; // last position of the mouse in the window
+
+public:
+	// constructor for the InputState class
+	InputState() {
+		for (int k = 0; k < sf::Keyboard::KeyCount; k++)
+			pressTime[k] = 0;
+	}
+
+	// forgets the presses and releases of the previous tick
+	void beginTick() {
+		pressed.reset();
+		released.reset();
+	}
+
+	// applies an event of the current tick
+	void apply(const InputEvent& event) {
+		if (event.kind == InputEvent::MouseMove) {
+			mouse = sf::Vector2i(event.x, event.y);
+			return;
+		}
+		if (event.key < 0 || event.key >= sf::Keyboard::KeyCount)
+			return;
+		if (event.kind == InputEvent::KeyDown) {
+			// a repeated press of a held key keeps the time it first went down
+			if (!down[event.key])
+				pressTime[event.key] = event.time;
+			down[event.key] = true;
+			pressed[event.key] = true;
+		}
+		else {
+			down[event.key] = false;
+			released[event.key] = true;
+		}
+	}
+
+	// returns the keys which are held
+	const KeySet& getDown() {
+		return down;
+	}
+
+	// returns the keys which went down during the tick
+	const KeySet& getPressed() {
+		return pressed;
+	}
+
+	// returns the keys which went up during the tick
+	const KeySet& getReleased() {
+		return released;
+	}
+
+	// returns the last position of the mouse in the window
+	sf::Vector2i getMouse() {
+		return mouse;
+	}
+
+	// returns the index of the held key among the n keys which went down last, or -1
+	int latest(const sf::Keyboard::Key* keys, int n) {
+		int best = -1;
+		for (int i = 0; i < n; i++)
+			if (down[keys[i]] && (best < 0 || pressTime[keys[i]] > pressTime[keys[best]]))
+				best = i;
+		return best;
+	}
+};
+
+// Thread which reads the keys of the game straight from the keyboard, a thousand times a second,
+// and writes every change into the input ring. The window's events only arrive when its thread
+// gets around to polling them, so this takes the time of drawing out of the input latency.
+// The keyboard is read as it is, so there is no key repeat and nothing is read without focus.
+// The mouse is read along with it, as only one thread may write into the ring.
+class InputPoller {
+private:
+	InputRing* ring;
+	const sf::Window* window;  // the mouse is read relative to it
+	chrono::steady_clock::time_point origin; // time 0 of the events
+	atomic<bool> focused;
+	atomic<bool> stopping;
+	bool held[13];
+	sf::Vector2i mouse;        // last position of the mouse which was sent
+	thread worker;
+
+public:
+	// constructor for the InputPoller class, starts reading the keyboard
+	InputPoller(InputRing* ring, const sf::Window* window, chrono::steady_clock::time_point origin) : focused(true), stopping(false) {
+		this->ring = ring;
+		this->window = window;
+		this->origin = origin;
+		for (int i = 0; i < 13; i++)
+			held[i] = false;
+		worker = thread(&InputPoller::poll, this);
+	}
+
+	// destructor for the InputPoller class
+	~InputPoller() {
+		stopping = true;
+		worker.join();
+	}
+
+	// the keyboard only belongs to the game while its window has the focus
+	void setFocused(bool focused) {
+		this->focused = focused;
+	}
+
+private:
+	// sends the changes of the keys until the poller is destroyed
+	void poll() {
+		static const sf::Keyboard::Key keys[13] = {
+			sf::Keyboard::Left, sf::Keyboard::Up, sf::Keyboard::Right, sf::Keyboard::Down,
+			sf::Keyboard::A, sf::Keyboard::W, sf::Keyboard::D, sf::Keyboard::S,
+			sf::Keyboard::Enter, sf::Keyboard::Space, sf::Keyboard::Y, sf::Keyboard::N, sf::Keyboard::F9
+		};
+		Tracer::nameThread("input");
+		while (!stopping) {
+			for (int i = 0; i < 13; i++) {
+				bool down = focused && sf::Keyboard::isKeyPressed(keys[i]);
+				if (down == held[i])
+					continue;
+
+				InputEvent event;
+				event.kind = down ? InputEvent::KeyDown : InputEvent::KeyUp;
+				event.key = keys[i];
+				event.time = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - origin).count();
+				if (ring->push(event))
+					held[i] = down;
+			}
+
+			sf::Vector2i pos = sf::Mouse::getPosition(*window);
+			if (focused && pos != mouse) {
+				InputEvent event;
+				event.kind = InputEvent::MouseMove;
+				event.key = sf::Keyboard::Unknown;
+				event.x = pos.x;
+				event.y = pos.y;
+				event.time = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - origin).count();
+				if (ring->push(event))
+					mouse = pos;
+			}
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+	}
+};
+
+// Reloads textures, the font and the level while the game runs, so that art can be changed without
+// restarting. A thread of its own waits for files to change, with inotify on Linux and by looking at
+// their modification times elsewhere, and decodes them right away. The game picks the results up
+// at the start of a frame or a tick, taking a lock only when there is something to pick up, so a
+// reload never stalls a frame and never changes anything in the middle of one.
+class HotReloader {
+private:
+	// decoded image waiting to be uploaded into its texture
+	class Upload {
+	public:
+		sf::Texture* texture;
+		sf::Image image;
+	};
+
+	string fontPath;
+	string levelPath;        // empty for the built-in level
+	mutex lock;
+	vector<Upload> uploads;  // for the next frame
+	vector<char> font;       // font file for the next frame
+	Level* level;            // for the next frame, or null
+	vector<TextureCache::Decoded> levelImages; // images of the textures the level needs first
+	atomic<bool> texturesReady;
+	atomic<bool> fontReady;
+	atomic<bool> levelReady;
+	atomic<bool> rescanning;
+	atomic<bool> stopping;
+	thread watcher;
+
+public:
+	// constructor for the HotReloader class
+	HotReloader(string fontPath, string levelPath) : texturesReady(false), fontReady(false), levelReady(false), rescanning(false), stopping(false) {
+		this->fontPath = fontPath;
+		this->levelPath = levelPath;
+		level = nullptr;
+		watcher = thread(&HotReloader::watch, this);
+	}
+
+	// destructor for the HotReloader class
+	~HotReloader() {
+		stopping = true;
+		watcher.join();
+		delete level;
+	}
+
+	// loads the decoded images into their textures, returns the number of textures which changed
+	// only to be called between two frames, on the thread drawing them
+	int uploadTextures() {
+		if (!texturesReady)
+			return 0;
+		vector<Upload> ready;
+		{
+			lock_guard<mutex> guard(lock);
+			ready.swap(uploads);
+			texturesReady = false;
+		}
+
+		TRACE_BEGIN("HotReloader::upload");
+		int n = 0;
+		for (size_t i = 0; i < ready.size(); i++) {
+			// the sprites keep the origins they got for the old size
+			if (ready[i].image.getSize() != ready[i].texture->getSize()) {
+				cerr << "a reloaded image has another size, restart the game to use it" << endl;
+				continue;
+			}
+			ready[i].texture->update(ready[i].image);
+			n++;
+		}
+		TRACE_END("HotReloader::upload");
+		return n;
+	}
+
+	// moves the reloaded font file into data, returns false if the font did not change
+	bool takeFont(vector<char>& data) {
+		if (!fontReady)
+			return false;
+		lock_guard<mutex> guard(lock);
+		data.swap(font);
+		fontReady = false;
+		return true;
+	}
+
+	// returns the reloaded level, which the caller then owns, or null if it did not change
+	// images gets the decoded images of the textures the level uses which were not made yet
+	Level* takeLevel(vector<TextureCache::Decoded>& images) {
+		if (!levelReady)
+			return nullptr;
+		lock_guard<mutex> guard(lock);
+		Level* next = level;
+		level = nullptr;
+		images.swap(levelImages);
+		levelImages.clear();
+		levelReady = false;
+		return next;
+	}
+
+	// looks for the files to watch again, after textures were loaded from files which may be new
+	void rescan() {
+		rescanning = true;
+	}
+
+private:
+	// adds the files to watch to paths: the font, the level and everything textures were made from
+	void getPaths(set<string>& paths) {
+		TextureCache::instance().getPaths(paths);
+		paths.insert(fontPath);
+		if (!levelPath.empty())
+			paths.insert(levelPath);
+	}
+
+	// waits for changed files until the reloader is destroyed
+	void watch() {
+		Tracer::nameThread("reload");
+#ifdef __linux__
+		int fd = inotify_init1(IN_NONBLOCK);
+		if (fd >= 0) {
+			watchDirectories(fd);
+			close(fd);
+			return;
+		}
+#endif
+		pollFiles();
+	}
+
+#ifdef __linux__
+	// reloads the files inotify reports as written; their directories are watched rather than the
+	// files themselves, since editors often save by renaming a new file over the old one
+	void watchDirectories(int fd) {
+		map<int, string> directories; // watch descriptor to the prefix of the paths in the directory
+		addWatches(fd, directories);
+
+		alignas(inotify_event) char buffer[4096];
+		while (!stopping) {
+			if (rescanning.exchange(false))
+				addWatches(fd, directories);
+			pollfd waiting = { fd, POLLIN, 0 };
+			if (poll(&waiting, 1, 100) <= 0)
+				continue;
+			ssize_t n = read(fd, buffer, sizeof(buffer));
+			for (ssize_t k = 0; k < n; ) {
+				const inotify_event* event = (const inotify_event*)(buffer + k);
+				if (event->len > 0)
+					reload(directories[event->wd] + event->name);
+				k += sizeof(inotify_event) + event->len;
+			}
+		}
+	}
 
-		bulletState = 0;
-		if (getTexture() == &textures[0] || getTexture() == &textures[1] || getTexture() == &textures[7] || getTexture() == &textures[8])
-			bulletState = 1;
-		if (getTexture() == &textures[6] || getTexture() == &textures[12] || getTexture() == &textures[13])
-			bulletState = 2;
-		if (getTexture() == &textures[3] || getTexture() == &textures[4] || getTexture() == &textures[5] || getTexture() == &textures[11])
-			bulletState = 3;
+	// watches the directories of the files to watch which are not watched yet
+	void addWatches(int fd, map<int, string>& directories) {
+		set<string> paths;
+		getPaths(paths);
+		set<string> watched;
+		for (map<int, string>::iterator it = directories.begin(); it != directories.end(); ++it)
+			watched.insert(it->second);
+		for (set<string>::iterator it = paths.begin(); it != paths.end(); ++it) {
+			size_t slash = it->rfind('/');
+			string prefix = slash == string::npos ? string() : it->substr(0, slash + 1);
+			if (!watched.insert(prefix).second)
+				continue;
+			int wd = inotify_add_watch(fd, prefix.empty() ? "." : prefix.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (wd >= 0)
+				directories[wd] = prefix;
+		}
 	}
+#endif
 
-	// checks which key released
-	void checkKeyrelease(WalkDirection dir) {
-		if (dir == Up) {
-			// we can make this code for only soldier 7 and 8. Because soldier7 and soldier8 are available while soldier walks upwards.
-			for (int i = 0; i < 14; i++) {
-				if (getTexture() == &textures[i]) {
-					if (i == 0) {
-						break;
-					}if (i == 1) {
-					}if (i == 2) {
-					}if (i == 3) {
-					}if (i == 4) {
-					}if (i == 5) {
-					}if (i == 6) {
-					}if (i == 7) {
-						setTexture(textures[0]);
-					}if (i == 8) {
-						setTexture(textures[0]);
-					}if (i == 9) {
-					}if (i == 10) {
-					}if (i == 11) {
-					}if (i == 12) {
-					}if (i == 13) {
-					}
-				}
+	// reloads the files whose modification time changed, looking twice a second
+	void pollFiles() {
+		map<string, time_t> times;
+		while (!stopping) {
+			set<string> paths;
+			getPaths(paths);
+			for (set<string>::iterator it = paths.begin(); it != paths.end(); ++it) {
+				struct stat info;
+				if (stat(it->c_str(), &info) != 0)
+					continue;
+				map<string, time_t>::iterator known = times.find(*it);
+				if (known != times.end() && known->second != info.st_mtime)
+					reload(*it);
+				times[*it] = info.st_mtime;
 			}
+			for (int i = 0; i < 5 && !stopping; i++)
+				this_thread::sleep_for(chrono::milliseconds(100));
 		}
-		if (dir == Down) {
-			for (int i = 0; i < 14; i++) {
-				if (getTexture() == &textures[i]) {
-					if (i == 0) {
-					}
-					if (i == 1) {
-					}
-					if (i == 2) {
-					}
-					if (i == 3) {
-						setTexture(textures[4]);
-					}
-					if (i == 4) {
-						break;
-					}
-					if (i == 5) {
-					}
-					if (i == 6) {
-					}
-					if (i == 7) {
-					}
-					if (i == 8) {
-					}
-					if (i == 9) {
-					}
-					if (i == 10) {
-					}
-					if (i == 11) {
-						setTexture(textures[4]);
-					}
-					if (i == 12) {
-					}
-					if (i == 13) {
-					}
-				}
+	}
+
+	// decodes a changed file and hands it over, files the game does not use are ignored
+	void reload(string path) {
+		if (path == levelPath) {
+			Level* next = new Level;
+			string error;
+			if (!next->load(path, error)) {
+				cerr << error << endl;
+				delete next;
+				return;
 			}
+			// the textures the level switches to are decoded here, only uploading them is left
+			vector<TextureCache::Decoded> images;
+			TextureCache::Decoded decoded;
+			for (int type = 0; type < Level::NumTypes; type++) {
+				int states = type == Level::BarrelType ? Obstacles::numDamageStates : 1;
+				if (TextureCache::instance().decode(next->getTexture((Level::ObjectType)type), states, decoded))
+					images.push_back(decoded);
+			}
+			lock_guard<mutex> guard(lock);
+			delete level;
+			level = next;
+			levelImages.swap(images);
+			levelReady = true;
+			return;
 		}
-		if (dir == Left) {
-			for (int i = 0; i < 14; i++) {
-				if (getTexture() == &textures[i]) {
-					if (i == 0) {
-					}
-					if (i == 1) {
-					}
-					if (i == 2) {
-					}
-					if (i == 3) {
-					}
-					if (i == 4) {
-					}
-					if (i == 5) {
-					}
-					if (i == 6) {
-						break;
-					}
-					if (i == 7) {
-					}
-					if (i == 8) {
-					}
-					if (i == 9) {
-					}
-					if (i == 10) {
-					}
-					if (i == 11) {
-					}
-					if (i == 12) {
-						setTexture(textures[6]);
-					}
-					if (i == 13) {
-						setTexture(textures[6]);
-					}
-				}
+
+		if (path == fontPath) {
+			ifstream file(path.c_str(), ios::binary);
+			vector<char> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+			if (data.empty())
+				return;
+			lock_guard<mutex> guard(lock);
+			font.swap(data);
+			fontReady = true;
+			return;
+		}
+
+		vector<TextureCache::Source> sources;
+		TextureCache::instance().find(path, sources);
+		if (sources.empty())
+			return;
+		TRACE_BEGIN("HotReloader::decode");
+		sf::Image image;
+		bool loaded = image.loadFromFile(path);
+		vector<Upload> decoded(loaded ? sources.size() : 0);
+		for (size_t i = 0; i < decoded.size(); i++) {
+			decoded[i].texture = sources[i].texture;
+			if (sources[i].states > 1)
+				TextureCache::damage(image, sources[i].states, decoded[i].image);
+			else decoded[i].image = image;
+		}
+		TRACE_END("HotReloader::decode");
+		// a file which can not be read yet is still being written, its next change brings it
+		if (!loaded)
+			return;
+		lock_guard<mutex> guard(lock);
+		uploads.insert(uploads.end(), decoded.begin(), decoded.end());
+		texturesReady = true;
+	}
+};
+
+class Game : public EventListener {
+private:
+	float speed;
+	Level* level;      // the level as loaded, every restart starts from it again
+	Level* reloadedLevel; // owned by the game once the level file was reloaded, see setLevel
+	unsigned int seed; // of the current game
+	int numPlayers;
+	int width;         // size of the world
+	int height;
+	int windowWidth;   // size of the window, the world may be much larger
+	int windowHeight;
+	sf::RenderWindow* window;
+	WindowRenderer* renderer;      // replays the frames into the window
+	DrawRecorder* recorder;        // writes the frames into a capture file, if wanted
+	DrawList* drawList;            // the frame being recorded, none in headless games
+	TripleBuffer<DrawList> frames; // recorded frames on their way to the window
+	sf::Texture* bgTexture; // from the TextureCache, none in headless games
+	sf::Sprite bgSprite;
+	sf::View cameras[2]; // camera following each player, two when the screen is split
+	int numCameras;
+	World* world;        // bullets, and obstacles unless they are streamed
+	int levelEntities;   // the obstacles are the first entities of the world, bullets come after
+	Obstacles* obstacles;
+	OccupancyMap* occupancy; // cells next to obstacles, none when they are streamed
+	bool streamed;       // obstacles and ground are streamed from a world file
+	Player* players;
+	BulletList* bullets;
+	ParticleSystem* particles; // only when the frames are drawn
+	SoundManager* sounds;      // only when there is a window
+	BotController* bots;
+	sf::Text text;
+	sf::Font fonts[2];        // the font in use and the one a reloaded font goes into
+	vector<char> fontFiles[2]; // fonts loaded from memory need it as long as they are used
+	int currentFont;
+	HotReloader* reloader;    // reloads changed files, if wanted
+	atomic<Level*> nextLevel; // reloaded level whose textures are made, for the next tick
+	int ticks;
+	int shotsFired;
+	JobSystem* jobs;               // runs the loops of a tick in parallel, none for a headless match
+	FrameArena arena;              // temporary data of the current tick
+	EventQueue events;             // what happened in the tick, two events for every bullet at most
+	BarrelHealth* barrels;
+	long long tickAllocations;     // heap allocations of the last tick
+	atomic<bool> closing;          // the window is to be closed
+	chrono::steady_clock::time_point started; // time 0 of the input events
+	InputRing input;               // key events waiting for the next tick
+	InputState keys;               // keyboard as seen by the current tick
+	InputPoller* poller;           // reads the keyboard on its own thread, if wanted
+	bool twinStick;                // player 1 walks with the keys and aims with the mouse
+	double hitchMs;                // frames taking longer are written to disk, 0 for never
+	enum { hitchFrames = 120, maxHitchDumps = 10 };
+	long long frameStarts[hitchFrames]; // trace times the last frames started at
+	int hitches;                   // hitches written so far
+	int hitchQuiet;                // ticks until the next hitch is written
+
+public:
+	// constructor for the Game class
+	// a headless game has no window and loads no assets, it is only simulated; an offscreen game
+	// has no window either, but records its frames for checkFrame, with the pixels of its textures
+	// kept in memory
+	enum Mode { Windowed, Headless, Offscreen };
+	Game(float speed, Level& level, int np, unsigned int seed = 1, Mode mode = Windowed) : arena(64 * 1024), events(2 * 1024), closing(false) {
+		int w = level.getWidth();
+		int h = level.getHeight();
+
+		this->speed = speed;
+		this->level = &level;
+		reloadedLevel = nullptr;
+		this->seed = seed;
+		numPlayers = np;
+		width = w;
+		height = h;
+		windowWidth = w < 1024 ? w : 1024;
+		windowHeight = h < 768 ? h : 768;
+		numCameras = 1;
+		streamed = level.isChunked();
+		ticks = 0;
+		shotsFired = 0;
+		window = nullptr;
+		renderer = nullptr;
+		recorder = nullptr;
+		drawList = nullptr;
+		jobs = nullptr;
+		tickAllocations = 0;
+		started = chrono::steady_clock::now();
+		poller = nullptr;
+		reloader = nullptr;
+		nextLevel = nullptr;
+		currentFont = 0;
+		twinStick = false;
+		hitchMs = 0;
+		hitches = 0;
+		hitchQuiet = 0;
+		for (int i = 0; i < hitchFrames; i++)
+			frameStarts[i] = 0;
+
+		if (mode == Windowed) {
+			// create window
+			window = new sf::RenderWindow;
+			window->create(sf::VideoMode(windowWidth, windowHeight), "My game");
+			renderer = new WindowRenderer(window, &text);
+		}
+		if (mode != Headless)
+			drawList = new DrawList;
+		if (mode == Offscreen)
+			TextureCache::instance().setOffscreen(true);
+
+		world = new World(drawList);
+		bgTexture = nullptr;
+		buildLevel();
+
+		// create game objects
+		players = new Player[np];
+		bullets = new BulletList(world, &arena, &events, drawList, (float)w, (float)h, 1024);
+		particles = drawList ? new ParticleSystem(drawList, 65536) : nullptr;
+		sounds = window ? new SoundManager : nullptr;
+		bots = nullptr;
+		barrels = new BarrelHealth(obstacles, &events, 3, 600);
+
+		// the systems reacting to what the bullets run into
+		listen(barrels, EventQueue::bit(GameEvent::BarrelDamaged));
+		listen(this, EventQueue::bit(GameEvent::PlayerKilled));
+		if (particles)
+			listen(particles, EventQueue::bit(GameEvent::BarrelDestroyed));
+		if (sounds)
+			listen(sounds, EventQueue::bit(GameEvent::PlayerKilled) | EventQueue::bit(GameEvent::SandbagHit) | EventQueue::bit(GameEvent::BarrelDamaged) | EventQueue::bit(GameEvent::BarrelDestroyed));
+
+		// initialize game objects
+		for (int i = 0; i < np; i++) {
+			players[i].init(drawList, i < level.getNumSpawns() ? level.getSpawn(i) : Coord());
+			players[i].setSeed(seed * 7919u + i);
+		}
+
+		// players without a spawn point start at random locations
+		for (int i = level.getNumSpawns(); i < np; i++)
+			players[i].respawn((float)w, (float)h, *obstacles);
+
+		// load font
+		if (window) {
+			AssetBundle::instance().loadFont("font.ttf", fonts[0]);
+			text.setFont(fonts[0]);
+		}
+	}
+
+	// destructor for the Game class
+	~Game()
+	{
+		// delete pointers for prevent memory leaks
+		delete reloader;
+		delete poller;
+		delete recorder;
+		delete renderer;
+		delete window;
+		delete drawList;
+		delete occupancy;
+		delete obstacles;
+		delete world;
+		delete[] players;
+		delete bullets;
+		delete particles;
+		delete sounds;
+		delete bots;
+		delete barrels;
+		delete reloadedLevel;
+		delete nextLevel.load();
+	}
+
+	// builds the background and the obstacles of the level
+	void buildLevel() {
+		// load background image and enable repeating
+		if (drawList) {
+			TRACE_BEGIN("Game::loadBackground");
+			bgTexture = TextureCache::instance().get(level->getTexture(Level::BackgroundType));
+			TRACE_END("Game::loadBackground");
+			bgTexture->setRepeated(true);
+			bgSprite.setTexture(*bgTexture);
+		}
+
+		// for sandbags and barrels, the center is higher
+		string barrelTexture = level->getTexture(Level::BarrelType);
+		string sandbagTexture = level->getTexture(Level::SandbagType);
+		if (streamed) {
+			sf::Texture* textures[Level::NumTypes] = { nullptr, nullptr, bgTexture };
+			if (drawList) {
+				textures[Level::BarrelType] = TextureCache::instance().getDamaged(barrelTexture, Obstacles::numDamageStates);
+				textures[Level::SandbagType] = TextureCache::instance().get(sandbagTexture);
 			}
+			obstacles = new ChunkedObstacleMap(level->getWorld(), drawList, sf::Vector2u(windowWidth, windowHeight), textures, 0.3f, 0.4f);
+			occupancy = nullptr;
 		}
-		if (dir == Right) {
-			for (int i = 0; i < 14; i++) {
-				if (getTexture() == &textures[i]) {
-					if (i == 0) {
-					}
-					if (i == 1) {
-					}
-					if (i == 2) {
-						break;
-					}
-					if (i == 3) {
-					}
-					if (i == 4) {
-					}
-					if (i == 5) {
-					}
-					if (i == 6) {
-					}
-					if (i == 7) {
-					}
-					if (i == 8) {
-					}
-					if (i == 9) {
-						setTexture(textures[2]);
-					}
-					if (i == 10) {
-						setTexture(textures[2]);
-					}
-					if (i == 11) {
-					}
-					if (i == 12) {
-					}
-					if (i == 13) {
-					}
-				}
+		else {
+			ObstacleMap* objects = new ObstacleMap(world);
+			for (int i = 0; i < level->getNumObstacles(); i++) {
+				if (level->getObstacleType(i) == Level::BarrelType)
+					objects->addBarrel(level->getObstaclePosition(i), barrelTexture);
+				else objects->addSandbag(level->getObstaclePosition(i), sandbagTexture);
+			}
+			objects->buildGrids((float)width, (float)height);
+			obstacles = objects;
+			occupancy = new OccupancyMap((float)width, (float)height, 8);
+			occupancy->build(*obstacles);
+		}
+		levelEntities = world->getSize();
+	}
+
+	// draws game background over the part of the world inside the rectangle
+	void drawBackground(sf::FloatRect area) {
+		// the texture repeats, so the rectangle of the texture is simply the rectangle of the world
+		sf::FloatRect world(0, 0, (float)width, (float)height);
+		sf::FloatRect visible;
+		if (!area.intersects(world, visible))
+			return;
+		bgSprite.setTextureRect(sf::IntRect((int)visible.left, (int)visible.top, (int)ceil(visible.width), (int)ceil(visible.height)));
+		bgSprite.setPosition((float)(int)visible.left, (float)(int)visible.top);
+		drawList->draw(bgSprite);
+	};
+
+	// splits the screen between the first two players
+	void setSplitScreen(bool split) {
+		numCameras = split ? 2 : 1;
+	}
+
+	// moves the camera over its player, without showing anything beyond the edges of the world
+	void updateCamera(int c) {
+		float viewWidth = (float)windowWidth / numCameras;
+		float viewHeight = (float)windowHeight;
+		Coord pos = players[c].getPosition();
+
+		float x = pos.x;
+		float y = pos.y;
+		if (x < viewWidth / 2) x = viewWidth / 2;
+		if (x > width - viewWidth / 2) x = width - viewWidth / 2;
+		if (y < viewHeight / 2) y = viewHeight / 2;
+		if (y > height - viewHeight / 2) y = height - viewHeight / 2;
+
+		cameras[c].setSize(viewWidth, viewHeight);
+		cameras[c].setCenter(floor(x), floor(y));
+		cameras[c].setViewport(sf::FloatRect((float)c / numCameras, 0, 1.0f / numCameras, 1));
+	}
+
+	// draws the newest recorded frame and updates screen, returns false if there was no new frame
+	bool update() {
+		if (reloader)
+			applyReloadedArt();
+		if (!render(*renderer))
+			return false;
+		if (recorder) {
+			TRACE_BEGIN("DrawRecorder::record");
+			recorder->record(frames.getFront());
+			TRACE_END("DrawRecorder::record");
+		}
+		TRACE_BEGIN("Window::display");
+		window->display();
+		TRACE_END("Window::display");
+		return true;
+	}
+
+	// uploads the textures and switches to the font the reloader decoded since the last frame
+	// a reloaded level gets its textures made here too, and is then played from the next tick
+	void applyReloadedArt() {
+		reloader->uploadTextures();
+
+		vector<TextureCache::Decoded> images;
+		Level* next = reloader->takeLevel(images);
+		if (next) {
+			TRACE_BEGIN("HotReloader::addLevel");
+			for (size_t i = 0; i < images.size(); i++)
+				TextureCache::instance().add(images[i]);
+			TRACE_END("HotReloader::addLevel");
+			// a level the simulation did not take yet is replaced
+			delete nextLevel.exchange(next);
+			// the level may take its textures from files which are not watched yet
+			reloader->rescan();
+		}
+
+		// the font in use stays untouched, the new one is loaded into the other one
+		int spare = 1 - currentFont;
+		if (reloader->takeFont(fontFiles[spare]) && fonts[spare].loadFromMemory(&fontFiles[spare][0], fontFiles[spare].size())) {
+			currentFont = spare;
+			text.setFont(fonts[spare]);
+		}
+	}
+
+	// draws the newest recorded frame with a renderer, returns false if there was no new frame
+	bool render(Renderer& target) {
+		if (!frames.update())
+			return false;
+		TRACE_BEGIN("DrawList::replay");
+		frames.getFront().replay(target);
+		TRACE_END("DrawList::replay");
+		return true;
+	}
+
+	// renders the last frame in software and compares it with the image at the path, pixel by
+	// pixel; writes the image there instead if there is none yet
+	// returns the number of pixels which differ, or -1 if the image could not be written
+	// an offscreen game has no font, so its frames show no text
+	long long checkFrame(string path) {
+		SoftwareRenderer software(windowWidth, windowHeight, jobs, &text);
+		TextureCache::instance().addPixels([&](const sf::Texture* texture, const sf::Image& image) {
+			software.setPixels(texture, image, texture->isSmooth(), texture->isRepeated());
+		});
+		render(software);
+		sf::Image frame = software.getImage();
+
+		sf::Image golden;
+		if (!ifstream(path.c_str()) || !golden.loadFromFile(path))
+			return frame.saveToFile(path) ? 0 : -1;
+		if (golden.getSize() != frame.getSize())
+			return (long long)windowWidth * windowHeight;
+		const sf::Uint8* a = frame.getPixelsPtr();
+		const sf::Uint8* b = golden.getPixelsPtr();
+		long long differ = 0;
+		for (int i = 0; i < windowWidth * windowHeight; i++)
+			if (memcmp(a + i * 4, b + i * 4, 4) != 0)
+				differ++;
+		return differ;
+	}
+
+	// plays until the window is closed or maxTicks ticks were simulated, one tick every tickSeconds
+	// when threaded, the simulation runs on its own thread and a slow window never delays a tick;
+	// renderDelay makes every frame of the window that much slower, to measure exactly that
+	TickStats run(bool threaded, double tickSeconds, int maxTicks = 0, double renderDelay = 0) {
+		TickStats stats;
+		if (threaded) {
+			window->setVerticalSyncEnabled(true);
+			thread simulation(&Game::simulate, this, tickSeconds, maxTicks, &stats);
+
+			// this thread only passes the events on and shows the frames
+			while (!closing) {
+				sf::Event event;
+				while (window->pollEvent(event))
+					handleEvent(event);
+				if (update())
+					this_thread::sleep_for(chrono::duration<double>(renderDelay));
+				else this_thread::sleep_for(chrono::milliseconds(1));
+			}
+			simulation.join();
+			window->close();
+			return stats;
+		}
+
+		auto next = chrono::steady_clock::now();
+		auto last = next;
+		while (window->isOpen() && (maxTicks == 0 || ticks < maxTicks)) {
+			auto now = chrono::steady_clock::now();
+			if (ticks > 0) {
+				double ms = chrono::duration<double, milli>(now - last).count();
+				stats.add(ms);
+				checkHitch(ms);
 			}
+			last = now;
+			frameStarts[ticks % hitchFrames] = Tracer::instance().now();
+
+			// process game events
+			processEvents();
+			stats.addAllocations(tickAllocations);
+
+			// draw all objects and update screen
+			update();
+			this_thread::sleep_for(chrono::duration<double>(renderDelay));
+
+			// sleep code limits the speed
+			next += chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(tickSeconds));
+			this_thread::sleep_until(next);
+		}
+		return stats;
+	}
+
+	// writes every frame shown in the window into a capture file, returns false if it can not be written
+	bool startRecording(string path) {
+		delete recorder;
+		recorder = new DrawRecorder(path, windowWidth, windowHeight);
+		return recorder->isOpen();
+	}
+
+	// reads the keyboard on a thread of its own instead of waiting for the window's events
+	void setInputThread(bool on) {
+		delete poller;
+		poller = on && window ? new InputPoller(&input, window, started) : nullptr;
+	}
+
+	// reloads the textures, the font and the level file at levelPath whenever they change on disk
+	// levelPath is empty for the built-in level
+	void setHotReload(bool on, string levelPath) {
+		delete reloader;
+		reloader = on && window ? new HotReloader("font.ttf", levelPath) : nullptr;
+	}
+
+	// switches to a reloaded version of the level and starts a new game on it, the game then owns
+	// the level; only a level of the same size which is not streamed can replace the current one
+	void setLevel(Level* next) {
+		if (streamed || next->isChunked() || next->getWidth() != width || next->getHeight() != height) {
+			cerr << "the reloaded level has another size or is streamed, restart the game to play it" << endl;
+			delete next;
+			return;
 		}
+		TRACE_BEGIN("Game::setLevel");
+
+		// everything built from the obstacles is built again, the bots stay bots
+		events.unsubscribe(barrels);
+		delete barrels;
+		delete occupancy;
+		delete obstacles;
+		world->reset(0);
+		delete reloadedLevel;
+		reloadedLevel = next;
+		level = next;
+		buildLevel();
+
+		BotController* old = bots;
+		bots = nullptr;
+		for (int i = 0; i < numPlayers; i++) {
+			if (old && old->controls(i))
+				setBot(i);
+		}
+		delete old;
+		barrels = new BarrelHealth(obstacles, &events, 3, 600);
+		listen(barrels, EventQueue::bit(GameEvent::BarrelDamaged));
+
+		reset(seed);
+		TRACE_END("Game::setLevel");
 	}
-};
 
-// Bullet class inherits from base Object class
-class Bullet : public Object {
-private:
-	float speed;
-	float angle;
-	Bullet* next;
+	// lets player 1 aim with the mouse in any direction instead of shooting where the player faces
+	void setTwinStick(bool on) {
+		twinStick = on && window;
+		players[0].setAim(-1);
+	}
 
-public:
-	// moves the bullet in its travel direction (angle)
-	void move() {
-		float offsetX = +speed * cos(angle);
-		float offsetY = -speed * sin(angle);
-		Object::move(offsetX, offsetY);
+	// writes a snapshot and the trace of the last frames whenever a frame takes longer than ms
+	void setHitchThreshold(double ms) {
+		hitchMs = ms;
 	}
 
-	// sets the pointer to next bullet in a linked list
-	void setNext(Bullet* next) {
-		this->next = next;
+	// returns true if the window is still open
+	bool isOpen() {
+		return window->isOpen();
 	}
 
-	// returns the pointer to next bullet in a linked list
-	Bullet* getNext() {
-		return next;
+	// returns the statistics of the match so far
+	MatchStats getStats() {
+		MatchStats stats;
+		stats.ticks = ticks;
+		stats.shotsFired = shotsFired;
+		stats.hits = bullets->getHits();
+		stats.barrelsDestroyed = barrels->getDestroyed();
+		stats.shotsRejected = bullets->getRejected();
+		stats.winner = gameOver() ? leader() : -1;
+		return stats;
 	}
 
-	// sets the bullet speed
-	void setSpeed(float speed) {
-		this->speed = speed;
+	// returns false, with the reason in error, if bots can not play on the level: they plan on a
+	// grid over the whole map, which a streamed world or a very large map is too big for
+	static bool allowsBots(Level& level, string& error) {
+		if (level.isChunked()) {
+			error = "bots can not play on a streamed world";
+			return false;
+		}
+		if (!BotController::fits((float)level.getWidth(), (float)level.getHeight())) {
+			error = "the map is too large for bots";
+			return false;
+		}
+		return true;
 	}
 
-	// sets the bullet angle
-	void setAngle(float radians) {
-		this->angle = radians;
-		Object::setAngle(radians + pi / 2);
+	// hands the control of a player over to a bot, returns false if bots can not play on the level
+	// the bots are only built once the first player is handed over
+	bool setBot(int player) {
+		if (!bots) {
+			string error;
+			if (!allowsBots(*level, error))
+				return false;
+			bots = new BotController((float)width, (float)height, numPlayers, obstacles->getNumBarrels());
+			bots->addObstacles(*obstacles);
+		}
+		bots->setBot(player, true);
+		return true;
 	}
-};
 
-// Bullet list class
-class BulletList {
-private:
-	sf::RenderWindow* window;
-	Bullet* list;
+	// returns true if the player is controlled by a bot
+	bool isBot(int player) {
+		return bots && bots->controls(player);
+	}
 
-public:
-	// constructor for the BulletList class
-	BulletList(sf::RenderWindow* window) {
-		this->window = window;
-		list = nullptr;
+	// starts a new game in place: bullets, particles, barrels, players and bots go back to the
+	// level as loaded, while the window, the textures and the memory of every system are kept.
+	// With the same seed, the game plays exactly like a new Game of the level.
+	void reset(unsigned int seed) {
+		TRACE_BEGIN("Game::reset");
+		this->seed = seed;
+		ticks = 0;
+		shotsFired = 0;
+		events.clear();
+		bullets->reset();
+		world->reset(levelEntities);
+		if (particles)
+			particles->clear();
+		barrels->reset();
+		if (bots)
+			bots->reset();
+
+		for (int i = 0; i < numPlayers; i++) {
+			players[i].reset(i < level->getNumSpawns() ? level->getSpawn(i) : Coord());
+			players[i].setSeed(seed * 7919u + i);
+		}
+		for (int i = level->getNumSpawns(); i < numPlayers; i++)
+			players[i].respawn((float)width, (float)height, *obstacles);
+		TRACE_END("Game::reset");
 	}
 
-	// destructor for the BulletList class
-	~BulletList() {
-		// delete all bullets in the linked list
-		while (list) {
-			list = remove(nullptr, list);
+	// lets the systems of every tick run their loops on the threads of the job system
+	// the results stay exactly the same, only the time a tick takes changes
+	void setJobs(JobSystem* jobs) {
+		this->jobs = jobs;
+	}
+
+	// plays the same headless match of np bots on 1 up to 32 threads and prints the time per tick
+	// and the particle system's time per frame, the matches have to end exactly alike
+	static void benchmark(Level& level, int np, int ticks) {
+		double base = 0;
+		MatchStats first;
+		for (int threads = 1; threads <= 32; threads *= 2) {
+			JobSystem jobs(threads - 1);
+			Game game(10, level, np, 1, Game::Headless);
+			game.setJobs(&jobs);
+			for (int i = 0; i < np; i++)
+				game.setBot(i);
+
+			// the first half of the match fills the caches, the second half should not allocate
+			long long allocations = 0;
+			auto start = chrono::steady_clock::now();
+			for (int tick = 0; tick < ticks; tick++) {
+				long long before = JobSystem::allocations(&jobs);
+				game.step();
+				if (tick >= ticks / 2)
+					allocations += JobSystem::allocations(&jobs) - before;
+			}
+			double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / ticks;
+			if (threads == 1)
+				base = ms;
+
+			MatchStats stats = game.getStats();
+			if (threads == 1)
+				first = stats;
+			bool same = stats.shotsFired == first.shotsFired && stats.hits == first.hits
+				&& stats.barrelsDestroyed == first.barrelsDestroyed && stats.winner == first.winner;
+			cout << threads << " threads: " << ms << " ms per tick, speedup " << base / ms
+				<< (same ? ", same match" : ", DIFFERENT MATCH") << ", " << allocations
+				<< " allocations in the second half" << endl << "  ";
+			ParticleSystem::benchmark(65536, 200, &jobs);
 		}
 	}
 
-	// adds a new bullet to the list
-	void add(Coord pos, int state) {
+	// returns the scoreboard, or the winning message once the game is over, made in the arena
+	const char* formatScoreboard(FrameArena& arena) {
+		if (gameOver())
+			return arena.format("Player %d wins, start over? (Y/N)", leader() + 1);
+		const char* str = arena.format("Player  1: %d\nPlayer 2: %d", players[0].getScore(), players[1].getScore());
+		if (numPlayers > 2)
+			str = arena.format("%s\nLeader: Player %d: %d", str, leader() + 1, players[leader()].getScore());
+		return str;
+	}
+
+	// gives every player the same score, for the benchmarks
+	void setScores(int score) {
+		for (int i = 0; i < numPlayers; i++)
+			players[i].setScore(score);
+	}
+
+	// returns the index of the player with the highest score
+	int leader() {
+		int best = 0;
+		for (int i = 1; i < numPlayers; i++)
+			if (players[i].getScore() > players[best].getScore())
+				best = i;
+		return best;
+	}
 
-		// create a new bullet
-		Bullet* bullet = new Bullet;
-		bullet->init(window, "bullet.png", pos);
-		bullet->setSpeed(40);
-		bullet->setAngle(state * pi / 2);
+	// fires a bullet in the direction the player aims at, if the weapon and the bullet budget allow it
+	void fire(int i) {
+		Weapon& weapon = players[i].getWeapon();
+		if (!weapon.canFire() || !bullets->add(players[i].getPosition(), players[i].getAim(), i))
+			return;
+		weapon.fire();
+		if (particles)
+			particles->muzzleFlash(players[i].getPosition(), Directions::angle(players[i].getAim()));
+		if (sounds)
+			sounds->play(SoundManager::ShotSound, players[i].getPosition());
+		shotsFired++;
+	}
 
-		// set the new bullet at the start of the list
-		bullet->setNext(list);
-		list = bullet;
+	// returns the direction held down by the player, if any
+	// of several held directions the one pressed last wins, releasing it goes back to the others
+	bool heldDirection(int i, Player::WalkDirection& dir) {
+		// player 1 walks with the arrow keys and player 2 with WASD
+		static const sf::Keyboard::Key walkKeys[2][4] = {
+			{ sf::Keyboard::Left, sf::Keyboard::Up, sf::Keyboard::Right, sf::Keyboard::Down },
+			{ sf::Keyboard::A, sf::Keyboard::W, sf::Keyboard::D, sf::Keyboard::S }
+		};
+		if (i > 1)
+			return false;
+		int d = keys.latest(walkKeys[i], 4);
+		if (d < 0)
+			return false;
+		dir = (Player::WalkDirection)d;
+		return true;
 	}
 
-	// removes the bullet from the list
-	Bullet* remove(Bullet* prev, Bullet* bullet) {
-		// next bullet in the list after the one being deleted
-		Bullet* next = bullet->getNext();
+	// walks the player. With slide, a step running into something is turned 45 degrees to either side
+	// so the player slides around the obstacle; when that does not help the previous position is restored.
+	// Bots do not slide, their paths already lead around the obstacles on the cells of the NavGrid.
+	void walkPlayer(int i, Player::WalkDirection dir, bool slide) {
+		Coord prevPos = players[i].getPosition();
+		players[i].walk(speed, dir);
+		if (!blocked(i))
+			return;
+		if (!slide) {
+			players[i].setPosition(prevPos.x, prevPos.y);
+			return;
+		}
 
-		// update the next pointer of the previous bullet in the list (or list pointer if deleting the first bullet)
-		if (prev)
-			prev->setNext(next);
-		else list = next;
+		Coord step = players[i].getPosition();
+		float dx = (step.x - prevPos.x) * 0.70710678f;
+		float dy = (step.y - prevPos.y) * 0.70710678f;
+		players[i].setPosition(prevPos.x + dx - dy, prevPos.y + dy + dx);
+		if (!blocked(i))
+			return;
+		players[i].setPosition(prevPos.x + dx + dy, prevPos.y + dy - dx);
+		if (!blocked(i))
+			return;
+		players[i].setPosition(prevPos.x, prevPos.y);
+	}
 
-		// delete the bullet and return the pointer to the next one in the list
-		delete bullet;
-		return next;
+	// returns true if the player is off the edge of the screen or collides with sandbags or barrels
+	bool blocked(int i) {
+		if (!players[i].insideWindow(50, (float)width, (float)height))
+			return true;
+		if (occupancy)
+			return occupancy->collides(players[i].getPosition(), *obstacles);
+		return players[i].checkCollision(*obstacles);
 	}
 
-	// moves every bullet in the list
-	void update() {
-		// move each bullet
-		for (Bullet* bullet = list; bullet; bullet = bullet->getNext()) {
-			bullet->move();
+	// returns true if the game is over
+	bool gameOver() {
+		// when a player reaches 10 total shots, game is over
+		for (int i = 0; i < numPlayers; i++)
+			if (players[i].getScore() >= 10)
+				return true;
+		return false;
+	}
+
+	// processes game events
+	void processEvents() {
+		sf::Event event;
+
+		// all events checking in here
+		while (window->pollEvent(event))
+			handleEvent(event);
+		if (closing)
+			window->close();
+
+		tick();
+	}
+
+	// advances the simulation and records its frame
+	void tick() {
+		// its textures are made already, see applyReloadedArt
+		Level* next = nextLevel.exchange(nullptr);
+		if (next)
+			setLevel(next);
+
+		long long before = JobSystem::allocations(jobs);
+		TRACE_BEGIN("Game::tick");
+		TRACE_BEGIN("Game::readInput");
+		readInput();
+		TRACE_END("Game::readInput");
+		TRACE_BEGIN("Game::step");
+		step();
+		TRACE_END("Game::step");
+		TRACE_BEGIN("Game::draw");
+		draw();
+		TRACE_END("Game::draw");
+		TRACE_END("Game::tick");
+		tickAllocations = JobSystem::allocations(jobs) - before;
+	}
+
+	// reacts to an event of the window, keys are recorded for the next tick
+	void handleEvent(const sf::Event& event) {
+		if (event.type == sf::Event::Closed) {
+			closing = true; // option for closing the game
+		}
+
+		// the poller reads the keys itself, it only needs to know whether they are meant for the game
+		if (poller) {
+			if (event.type == sf::Event::GainedFocus || event.type == sf::Event::LostFocus)
+				poller->setFocused(event.type == sf::Event::GainedFocus);
+			return;
+		}
+
+		if (event.type == sf::Event::KeyPressed || event.type == sf::Event::KeyReleased) {
+			InputEvent key;
+			key.kind = event.type == sf::Event::KeyPressed ? InputEvent::KeyDown : InputEvent::KeyUp;
+			key.key = event.key.code;
+			key.time = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started).count();
+			input.push(key);
+		}
+
+		if (event.type == sf::Event::MouseMoved) {
+			InputEvent move;
+			move.kind = InputEvent::MouseMove;
+			move.key = sf::Keyboard::Unknown;
+			move.x = event.mouseMove.x;
+			move.y = event.mouseMove.y;
+			move.time = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started).count();
+			input.push(move);
 		}
 	}
 
-	// checks whether a bullet in the list collided with other objects or with the edge of the screen
-	void checkCollision(Player* players, Barrel* barrels, Sandbag* sandbags, int np, int nb, int ns) {
+	// applies the key events which arrived since the last tick, in the order they happened
+	void readInput() {
+		InputEvent event;
+		keys.beginTick();
+		while (input.pop(event)) {
+			keys.apply(event);
+			if (event.kind == InputEvent::KeyDown)
+				pressKey(event.key);
+		}
+		// the player walks under the mouse as well, so the aim is renewed every tick
+		if (twinStick)
+			aimAtMouse();
+	}
 
-		// collide bullets with the edge of the screen
-		Bullet* prev = nullptr;
-		for (Bullet* bullet = list; bullet; ) {
-			if (!bullet->insideWindow(0)) {
-				// delete the bullet
-				bullet = remove(prev, bullet);
-			}
-			else {
-				// go to the next bullet
-				prev = bullet;
-				bullet = bullet->getNext();
-			}
+	// aims the shots of player 1 at the mouse, in any of the steps of Directions
+	void aimAtMouse() {
+		if (isBot(0))
+			return;
+		// the mouse is in the first camera's part of the window, which shows the world around player 1
+		sf::Vector2i mouse = keys.getMouse();
+		sf::FloatRect viewport = cameras[0].getViewport();
+		sf::Vector2f center = cameras[0].getCenter();
+		sf::Vector2f size = cameras[0].getSize();
+		float x = center.x + ((mouse.x - viewport.left * windowWidth) / (viewport.width * windowWidth) - 0.5f) * size.x;
+		float y = center.y + ((mouse.y - viewport.top * windowHeight) / (viewport.height * windowHeight) - 0.5f) * size.y;
+		Coord pos = players[0].getPosition();
+		if (x != pos.x || y != pos.y)
+			players[0].setAim(Directions::quantize(atan2(pos.y - y, x - pos.x)));
+	}
+
+	// reacts to a pressed key, walking keys are only looked at while they are held
+	void pressKey(sf::Keyboard::Key key) {
+		switch (key) {
+		case sf::Keyboard::Enter:
+			// fire bullet by player 1
+			if (!gameOver() && !isBot(0))
+				fire(0);
+			break;
+
+		case sf::Keyboard::Space:
+			// fire bullet by player 2
+			if (!gameOver() && !isBot(1))
+				fire(1);
+			break;
+
+		case sf::Keyboard::Y:
+			// restart the game
+			if (gameOver())
+				reset(seed + 1);
+			break;
+
+		case sf::Keyboard::N:
+			// exit the game
+			if (gameOver())
+				closing = true;
+			break;
+
+		case sf::Keyboard::F9:
+			// write the trace recorded so far
+			if (Tracer::enabled)
+				Tracer::instance().flush();
+			break;
+
+		default:
+			break;
 		}
+	}
 
-		// collide bullets with players
-		for (int i = 0; i < np; i++) {
-			Bullet* prev = nullptr;
-			for (Bullet* bullet = list; bullet; ) {
-				if (bullet->collideObject(players[i])) {
-					// delete the bullet, respawn the player, and increment the opposite score
-					bullet = remove(prev, bullet);
-					players[i].respawn();
-					players[1 - i].incrementScore();
-				}
-				else {
-					// go to the next bullet
-					prev = bullet;
-					bullet = bullet->getNext();
-				}
+	// advances the simulation by one frame
+	void step() {
+		ticks++;
+		arena.reset();
+
+		// the sounds are heard from the players the cameras follow
+		if (sounds) {
+			Coord positions[2] = { players[0].getPosition(), players[1].getPosition() };
+			sounds->setListeners(positions, numCameras);
+		}
+
+		for (int i = 0; i < numPlayers; i++)
+			players[i].getWeapon().update();
+
+		// destroyed barrels come back after a while
+		barrels->update(players, numPlayers);
+
+		// let the bots plan their moves; they see every change of the barrels even when the game is
+		// over, since barrels still respawn and get shot then
+		TRACE_BEGIN("BotController::update");
+		if (bots) {
+			bots->syncBarrels(*obstacles);
+			if (!gameOver())
+				bots->update(players, *obstacles, jobs);
+		}
+		if (occupancy)
+			occupancy->update(*obstacles);
+		obstacles->clearChanges();
+		TRACE_END("BotController::update");
+
+		// walk function for the players, driven by the held keys or by a bot
+		TRACE_BEGIN("Game::walk");
+		for (int i = 0; i < numPlayers; i++) {
+			Player::WalkDirection dir;
+			if (isBot(i)) {
+				const BotAction& action = bots->getAction(i);
+				if (gameOver())
+					continue;
+				if (action.fire)
+					fire(i);
+				if (action.walk)
+					walkPlayer(i, action.dir, false);
 			}
+			else if (heldDirection(i, dir))
+				walkPlayer(i, dir, true);
 		}
+		TRACE_END("Game::walk");
 
-		// collide bullets with sandbags
-		for (int i = 0; i < ns; i++) {
-			Bullet* prev = nullptr;
-			for (Bullet* bullet = list; bullet; ) {
-				if (bullet->collideObject(sandbags[i])) {
-					// delete the bullet
-					bullet = remove(prev, bullet);
-				}
-				else {
-					// go to the next bullet
-					prev = bullet;
-					bullet = bullet->getNext();
-				}
+		// move every bullet in the list
+		bullets->update(jobs);
+
+		// collisions of bullets with other objects
+		bullets->checkCollision(players, numPlayers, *obstacles, jobs);
+
+		TRACE_BEGIN("ParticleSystem::update");
+		if (particles)
+			particles->update(jobs);
+		TRACE_END("ParticleSystem::update");
+
+		// scores, barrel damage, sounds and explosions for what the bullets ran into
+		TRACE_BEGIN("EventQueue::dispatch");
+		events.dispatch();
+		TRACE_END("EventQueue::dispatch");
+	}
+
+	// a kill scores for the shooter and sends the victim back to a random place
+	void onEvent(const GameEvent& event) {
+		players[event.instigator].incrementScore();
+		players[event.subject].respawn((float)width, (float)height, *obstacles);
+	}
+
+	// records the game objects and the scoreboard, then hands the frame over to the window
+	void draw() {
+		particles->build(jobs);
+		for (int c = 0; c < numCameras; c++) {
+			updateCamera(c);
+			drawList->setView(cameras[c]);
+
+			// only what the camera sees is drawn
+			sf::Vector2f center = cameras[c].getCenter();
+			sf::Vector2f size = cameras[c].getSize();
+			sf::FloatRect area(center.x - size.x / 2, center.y - size.y / 2, size.x, size.y);
+
+			// draw grass background, streamed chunks bring their own
+			if (!streamed)
+				drawBackground(area);
+
+			// draw game objects
+			obstacles->paint(area);
+			sf::FloatRect near(area.left - 64, area.top - 64, area.width + 128, area.height + 128);
+			for (int i = 0; i < numPlayers; i++) {
+				Coord pos = players[i].getPosition();
+				if (near.contains(pos.x, pos.y))
+					players[i].paint();
 			}
+			bullets->paint(near);
+			particles->paint();
 		}
 
-		// collide bullets with visible barrels
-		for (int i = 0; i < nb; i++) {
-			// ignore hidden barrels
-			if (!barrels[i].getVisible())
-				continue;
+		// display the scoreboard at the bottom of the screen at the center, or the winning message
+		const char* str = formatScoreboard(arena);
+		drawList->drawText(str, sf::Vector2f(windowWidth * (gameOver() ? 0.2f : 0.4f), windowHeight * 0.9f));
 
-			Bullet* prev = nullptr;
-			for (Bullet* bullet = list; bullet; ) {
-				if (bullet->collideObject(barrels[i])) {
-					// delete the bullet and hide the barrel
-					bullet = remove(prev, bullet);
-					barrels[i].setVisible(false);
-				}
-				else {
-					// go to the next bullet
-					prev = bullet;
-					bullet = bullet->getNext();
-				}
+		frames.getBack().swap(*drawList);
+		frames.publish();
+		drawList->clear();
+	}
+
+private:
+	// hands the events of the kinds to a system of the game; the queue only has room for a few
+	// listeners, which the systems of a game must not outnumber
+	void listen(EventListener* listener, unsigned int kinds) {
+		if (!events.subscribe(listener, kinds))
+			cerr << "the event queue has no room for another listener, some events go unhandled" << endl;
+	}
+
+	// writes the state of the game and the trace of the last frames when the frame which just
+	// ended took too long; writing takes a while itself, so the frames after it are not looked at
+	void checkHitch(double ms) {
+		if (hitchQuiet > 0)
+			hitchQuiet--;
+		if (hitchMs <= 0 || ms < hitchMs || hitchQuiet > 0 || hitches == maxHitchDumps)
+			return;
+		hitches++;
+		hitchQuiet = hitchFrames;
+
+		// frameStarts still has the start of the hitch frame and of those before it
+		int first = ticks > hitchFrames ? ticks - hitchFrames + 1 : 1;
+		string name = "hitch" + to_string(hitches);
+		writeSnapshot(name + ".txt", ms);
+		Tracer::instance().write(name + ".json", frameStarts[first % hitchFrames]);
+		cerr << "frame " << ticks << " took " << ms << " ms, written to " << name << ".txt and " << name << ".json" << endl;
+	}
+
+	// writes the state of the game to a text file, in the style of a level file
+	void writeSnapshot(string path, double ms) {
+		ofstream file(path.c_str());
+		file << "# state of the game after a frame of " << ms << " ms" << endl;
+		file << "tick " << ticks << endl;
+		file << "size " << width << " " << height << endl;
+		for (int i = 0; i < numPlayers; i++) {
+			Coord pos = players[i].getPosition();
+			Weapon& weapon = players[i].getWeapon();
+			file << "player " << pos.x << " " << pos.y << " score " << players[i].getScore() << " aim " << players[i].getAim()
+				<< " rounds " << weapon.getRounds() << (weapon.isReloading() ? " reloading" : "")
+				<< (isBot(i) ? " bot" : "") << endl;
+		}
+		for (int i = 0; i < bullets->getNumBullets(); i++) {
+			Entity e = bullets->getBullet(i);
+			Coord pos = world->getPosition(e);
+			file << "bullet " << pos.x << " " << pos.y << " velocity " << world->velocity(e).x << " " << world->velocity(e).y
+				<< " owner " << world->collider(e).owner << endl;
+		}
+		// a streamed world would have to load every chunk to look at its barrels
+		if (!streamed) {
+			for (int i = 0; i < obstacles->getNumBarrels(); i++) {
+				if (obstacles->isBarrelVisible(i))
+					continue;
+				Coord pos = obstacles->getBarrelPosition(i);
+				file << "destroyed " << pos.x << " " << pos.y << endl;
 			}
 		}
 	}
 
-	void paint() {
-		// paint each bullet in the list
-		for (Bullet* bullet = list; bullet; bullet = bullet->getNext()) {
-			bullet->paint();
+	// simulation thread of a threaded run, it never waits for the window
+	void simulate(double tickSeconds, int maxTicks, TickStats* stats) {
+		Tracer::nameThread("simulation");
+		auto next = chrono::steady_clock::now();
+		auto last = next;
+		while (!closing && (maxTicks == 0 || ticks < maxTicks)) {
+			auto now = chrono::steady_clock::now();
+			if (ticks > 0) {
+				double ms = chrono::duration<double, milli>(now - last).count();
+				stats->add(ms);
+				checkHitch(ms);
+			}
+			last = now;
+			frameStarts[ticks % hitchFrames] = Tracer::instance().now();
+
+			tick();
+			stats->addAllocations(tickAllocations);
+
+			next += chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(tickSeconds));
+			this_thread::sleep_until(next);
 		}
+		closing = true;
 	}
 };
 
-class Game {
+// Runs headless bot-vs-bot matches in parallel and writes their statistics to a CSV file
+class MatchRunner {
 private:
-	float speed;
-	int numBarrels;
-	int numSandbags;
+	Level* level;
+	int numMatches;
+	int numThreads;
 	int numPlayers;
-	int width;
-	int height;
-	sf::RenderWindow* window;
-	sf::Texture bgTexture;
-	sf::Sprite bgSprite;
-	Barrel* barrels;
-	Sandbag* sandbags;
-	Player* players;
-	sf::Keyboard::Key* stickyKeys; // current sticky keys for each player
-	BulletList* bullets;
-	sf::Text text;
-	sf::Font font;
+	unsigned int seed;
+	int maxTicks;            // matches which take longer are stopped without a winner
+	MatchStats* results;
+	atomic<int> nextMatch;
 
 public:
-	// constructor for the Game class
-	Game(float speed, int w, int h, int nb, int ns, int np) {
-		this->speed = speed;
-		numBarrels = nb;
-		numSandbags = ns;
+	// constructor for the MatchRunner class
+	MatchRunner(Level* level, int matches, int threads, int np, unsigned int seed) : nextMatch(0) {
+		this->level = level;
+		numMatches = matches;
+		numThreads = threads > 0 ? threads : 1;
 		numPlayers = np;
-		width = w;
-		height = h;
+		this->seed = seed;
+		maxTicks = 100000;
+		results = new MatchStats[matches];
+	}
 
-		// create window
-		window = new sf::RenderWindow;
-		window->create(sf::VideoMode(width, height), "My game");
+	// destructor for the MatchRunner class
+	~MatchRunner() {
+		delete[] results;
+	}
 
-		// load background image and enable repeating
-		bgTexture.loadFromFile("grass.png");
-		bgTexture.setSmooth(true);
-		bgTexture.setRepeated(true);
-		bgSprite.setTexture(bgTexture);
-		bgSprite.setTextureRect(sf::IntRect(0, 0, w, h));
+	// plays all matches and writes one CSV row per match, returns false if the file can not be written
+	bool run(string path) {
+		auto start = chrono::steady_clock::now();
 
-		// create game objects
-		barrels = new Barrel[nb];
-		sandbags = new Sandbag[ns];
-		players = new Player[np];
-		stickyKeys = new sf::Keyboard::Key[np];
-		bullets = new BulletList(window);
+		// matches are independent, so workers only share the counter of the next match to play
+		vector<thread> workers;
+		for (int i = 0; i < numThreads; i++)
+			workers.push_back(thread(&MatchRunner::work, this));
+		for (int i = 0; i < numThreads; i++)
+			workers[i].join();
 
-		// initialize game objects
-		players[0].init(window, Coord(440, 650));
-		players[1].init(window, Coord(200, 250));
-		stickyKeys[0] = sf::Keyboard::Unknown;
-		stickyKeys[1] = sf::Keyboard::Unknown;
-		barrels[0].init(window, "barrel.png", Coord(950, 200));
-		barrels[1].init(window, "barrel.png", Coord(545, 400));
-		barrels[2].init(window, "barrel.png", Coord(800, 322));
-		barrels[3].init(window, "barrel.png", Coord(435, 500));
-		barrels[4].init(window, "barrel.png", Coord(100, 100));
-		sandbags[0].init(window, "bags.png", Coord(747, 140));
-		sandbags[1].init(window, "bags.png", Coord(268, 50));
-		sandbags[2].init(window, "bags.png", Coord(375, 110));
-		sandbags[3].init(window, "bags.png", Coord(60, 680));
-		sandbags[4].init(window, "bags.png", Coord(60, 460));
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		return writeCsv(path, seconds);
+	}
 
-		// load font
-		font.loadFromFile("font.ttf");
-		text.setFont(font);
+private:
+	// plays matches until there are none left
+	// every worker builds one game and restarts it in place for each of its matches
+	void work() {
+		Tracer::nameThread("match");
+		Game* game = nullptr;
+		for (int match = nextMatch++; match < numMatches; match = nextMatch++) {
+			if (!game) {
+				// the level is shared read-only by all games
+				game = new Game(10, *level, numPlayers, seed + match, Game::Headless);
+				for (int i = 0; i < numPlayers; i++)
+					game->setBot(i);
+			}
+			else game->reset(seed + match);
+			results[match] = play(*game);
+		}
+		delete game;
 	}
 
-	// destructor for the Game class
-	~Game()
-	{
-		// delete pointers for prevent memory leaks
-		delete window;
-		delete[] barrels;
-		delete[] sandbags;
-		delete[] players;
-		delete[] stickyKeys;
-		delete bullets;
+	// plays one complete match between bots
+	MatchStats play(Game& game) {
+		for (int tick = 0; tick < maxTicks && !game.gameOver(); tick++)
+			game.step();
+		return game.getStats();
 	}
 
-	// draws game background
-	void drawBackground() {
-		window->draw(bgSprite);
-	};
+	// writes the results and prints a summary of all matches
+	bool writeCsv(string path, double seconds) {
+		ofstream file(path.c_str());
+		if (!file) {
+			cerr << "can not write " << path << endl;
+			return false;
+		}
 
-	// draws all objects and updates screen
-	void update() {
-		window->display();
-	}
+		long long ticks = 0, shots = 0, hits = 0, barrels = 0, rejected = 0;
+		int finished = 0;
+		file << "match,seed,ticks,shots_fired,hits,hit_ratio,barrels_destroyed,winner,shots_rejected" << endl;
+		for (int i = 0; i < numMatches; i++) {
+			MatchStats& s = results[i];
+			float ratio = s.shotsFired > 0 ? (float)s.hits / s.shotsFired : 0;
+			file << i << "," << seed + i << "," << s.ticks << "," << s.shotsFired << "," << s.hits << ","
+				<< ratio << "," << s.barrelsDestroyed << "," << s.winner + 1 << "," << s.shotsRejected << endl;
 
-	// returns true if the window is still open
-	bool isOpen() {
-		return window->isOpen();
+			ticks += s.ticks;
+			rejected += s.shotsRejected;
+			shots += s.shotsFired;
+			hits += s.hits;
+			barrels += s.barrelsDestroyed;
+			if (s.winner >= 0)
+				finished++;
+		}
+
+		cout << numMatches << " matches (" << finished << " finished) on " << numThreads << " threads in "
+			<< seconds << " s, " << numMatches / seconds << " matches/s" << endl;
+		cout << "average ticks " << (double)ticks / numMatches << ", hit ratio "
+			<< (shots > 0 ? (double)hits / shots : 0) << ", barrels destroyed " << (double)barrels / numMatches
+			<< ", shots rejected " << rejected << endl;
+		return true;
 	}
+};
 
-	// returns true if the game is over
-	bool gameOver() {
-		// when a player reaches 10 total shots, game is over
-		for (int i = 0; i < numPlayers; i++)
-			if (players[i].getScore() >= 10)
-				return true;
-		return false;
+// Micro-benchmarks of the primitives the frames are spent in, in the manner of Google Benchmark.
+// Every case runs in batches which grow until one takes long enough to be timed, and the results
+// are written as JSON in Google Benchmark's format, so that its tools can compare two versions.
+class MicroBenchmarks {
+private:
+	class Result {
+	public:
+		string name;
+		long long iterations;
+		double realNs;  // per iteration
+		double cpuNs;
+		double itemsPerSecond;
+	};
+
+	vector<Result> results;
+	double minSeconds;      // a batch taking less is repeated with more iterations
+	volatile long long sink; // results of the cases, so that the compiler keeps their work
+
+public:
+	// constructor for the MicroBenchmarks class
+	MicroBenchmarks(double minSeconds) {
+		this->minSeconds = minSeconds;
+		sink = 0;
 	}
 
-	// processes game events
-	void processEvents() {
-		sf::Event event;
-		sf::Color color;
+	// runs every case, the obstacles come from the level
+	void run(Level& level) {
+		unsigned int seed = 1;
+		auto random = [&](float a, float b) {
+			seed = seed * 1103515245u + 12345u;
+			return a + (b - a) * (((seed >> 16) % 1000) / 1000.0f);
+		};
+		float w = (float)level.getWidth();
+		float h = (float)level.getHeight();
 
-		// all events checking in here
-		while (window->pollEvent(event)) {
-			if (event.type == sf::Event::Closed) {
-				window->close(); // option for closing the game
-			}
+		// every pair of n objects
+		for (int n = 16; n <= 256; n *= 4) {
+			vector<Object> objects(n);
+			for (int i = 0; i < n; i++)
+				objects[i].init(nullptr, string(), Coord(random(0, w), random(0, h)));
+			measure("Object::collideObject/" + to_string(n), (long long)n * (n - 1) / 2, [&]() {
+				long long hits = 0;
+				for (int i = 0; i < n; i++)
+					for (int j = i + 1; j < n; j++)
+						hits += objects[i].collideObject(objects[j]);
+				return hits;
+			});
+		}
 
-			// for walking, pressed keys should stick until released
-			if (!gameOver())
-				if (event.type == sf::Event::KeyPressed || event.type == sf::Event::KeyReleased)
-					switch (event.key.code) {
-					case sf::Keyboard::Left:
-					case sf::Keyboard::Up:
-					case sf::Keyboard::Right:
-					case sf::Keyboard::Down:
-						if (event.type == sf::Event::KeyPressed)
-							stickyKeys[0] = event.key.code;         // stick the key for player 1
-						else stickyKeys[0] = sf::Keyboard::Unknown; // unstick the key for player 1
-						break;
+		// a walk around a square, every step changes the frame of the animation
+		Player walker;
+		walker.init(nullptr, Coord(w / 2, h / 2));
+		long long steps = 0;
+		measure("Player::walk", 1, [&]() {
+			static const Player::WalkDirection square[4] = { Player::Right, Player::Down, Player::Left, Player::Up };
+			walker.walk(10, square[steps++ / 8 % 4]);
+			return (long long)walker.getBulletState();
+		});
 
-					case sf::Keyboard::A:
-					case sf::Keyboard::W:
-					case sf::Keyboard::D:
-					case sf::Keyboard::S:
-						if (event.type == sf::Event::KeyPressed)
-							stickyKeys[1] = event.key.code;         // stick the key for player 2
-						else stickyKeys[1] = sf::Keyboard::Unknown; // unstick the key for player 2
-						break;
-					}
+		// bullets in places where they hit nothing, so that every iteration does the same work
+		World world(nullptr);
+		ObstacleMap obstacles(&world);
+		if (!level.isChunked()) {
+			for (int i = 0; i < level.getNumObstacles(); i++) {
+				if (level.getObstacleType(i) == Level::BarrelType)
+					obstacles.addBarrel(level.getObstaclePosition(i), string());
+				else obstacles.addSandbag(level.getObstaclePosition(i), string());
+			}
+		}
+		obstacles.buildGrids(w, h);
+		Player players[2];
+		players[0].init(nullptr, Coord(-1000, -1000));
+		players[1].init(nullptr, Coord(-1000, -1000));
+		FrameArena arena(64 * 1024);
+		EventQueue events(2 * 4096);
+		for (int n = 64; n <= 4096; n *= 8) {
+			vector<Coord> open;
+			while ((int)open.size() < n) {
+				Coord pos(random(50, w - 50), random(50, h - 50));
+				if (!obstacles.hitSandbag(pos) && obstacles.hitBarrel(pos) < 0)
+					open.push_back(pos);
+			}
+			BulletList bullets(&world, &arena, &events, nullptr, w, h, n);
+			measure("BulletList::add+clear/" + to_string(n), n, [&]() {
+				for (int i = 0; i < n; i++)
+					bullets.add(open[i], i, 0);
+				bullets.clear();
+				return (long long)n;
+			});
+			// the bullets stand still, so that moving them does the same work in every iteration
+			// while they stay where they hit nothing, for any number of iterations
+			for (int i = 0; i < n; i++)
+				bullets.add(open[i], 0, 0);
+			for (int i = 0; i < n; i++)
+				world.velocity(bullets.getBullet(i)) = Velocity();
+			measure("BulletList::update/" + to_string(n), n, [&]() {
+				bullets.update(nullptr);
+				return (long long)n;
+			});
+			measure("BulletList::checkCollision/" + to_string(n), n, [&]() {
+				arena.reset();
+				events.clear();
+				bullets.checkCollision(players, 2, obstacles, nullptr);
+				return (long long)events.getSize();
+			});
+			bullets.clear();
+		}
 
-			// other pressed keys
-			if (event.type == sf::Event::KeyPressed)
-				switch (event.key.code) {
-				case sf::Keyboard::Enter:
-					// fire bullet by player 1
-					if (!gameOver())
-						bullets->add(players[0].getPosition(), players[0].getBulletState());
-					break;
-
-				case sf::Keyboard::Space:
-					// fire bullet by player 2
-					if (!gameOver())
-						bullets->add(players[1].getPosition(), players[1].getBulletState());
-					break;
-
-				case sf::Keyboard::Y:
-					// restart the game
-					if (gameOver()) {
-						for (int i = 0; i < numBarrels; i++)
-							barrels[i].setVisible(true);
-						for (int i = 0; i < numPlayers; i++)
-							players[i].setScore(0);
-					}
-					break;
+		// movement checks of players all over the world, with the obstacles and with their occupancy
+		OccupancyMap occupancy(w, h, 8);
+		occupancy.build(obstacles);
+		for (int n = 64; n <= 4096; n *= 8) {
+			vector<Coord> targets(n);
+			for (int i = 0; i < n; i++)
+				targets[i] = Coord(random(50, w - 50), random(50, h - 50));
+			measure("Obstacles::collides/" + to_string(n), n, [&]() {
+				long long hits = 0;
+				for (int i = 0; i < n; i++)
+					hits += obstacles.collides(targets[i]);
+				return hits;
+			});
+			measure("OccupancyMap::collides/" + to_string(n), n, [&]() {
+				long long hits = 0;
+				for (int i = 0; i < n; i++)
+					hits += occupancy.collides(targets[i], obstacles);
+				return hits;
+			});
+		}
 
-				case sf::Keyboard::N:
-					// exit the game
-					if (gameOver())
-						window->close();
-					break;
-				}
+		// the scoreboard of a running game and of a finished one
+		Game game(10, level, 3, 1, Game::Headless);
+		for (int over = 0; over < 2; over++) {
+			game.setScores(over ? 10 : 7);
+			measure(over ? "Game::formatScoreboard/over" : "Game::formatScoreboard", 1, [&]() {
+				arena.reset();
+				return (long long)strlen(game.formatScoreboard(arena));
+			});
 		}
 
-		// walk function for player 1
-		Coord prevPos = players[0].getPosition();
-		if (stickyKeys[0] == sf::Keyboard::Left)
-			players[0].walk(speed, Player::Left);
-		if (stickyKeys[0] == sf::Keyboard::Up)
-			players[0].walk(speed, Player::Up);
-		if (stickyKeys[0] == sf::Keyboard::Right)
-			players[0].walk(speed, Player::Right);
-		if (stickyKeys[0] == sf::Keyboard::Down)
-			players[0].walk(speed, Player::Down);
-
-		// on collision with the edge of the screen, restore the previous position of player 1
-		if (!players[0].insideWindow(50))
-			players[0].setPosition(prevPos.x, prevPos.y);
-
-		// on collision with sandbags or barrels, restore the previous position of player 1
-		if (players[0].checkCollision(barrels, sandbags, numBarrels, numSandbags))
-			players[0].setPosition(prevPos.x, prevPos.y);
-
-		// walk function for player 2
-		prevPos = players[1].getPosition();
-		if (stickyKeys[1] == sf::Keyboard::A)
-			players[1].walk(speed, Player::Left);
-		if (stickyKeys[1] == sf::Keyboard::W)
-			players[1].walk(speed, Player::Up);
-		if (stickyKeys[1] == sf::Keyboard::D)
-			players[1].walk(speed, Player::Right);
-		if (stickyKeys[1] == sf::Keyboard::S)
-			players[1].walk(speed, Player::Down);
-
-		// on collision with the edge of the screen, restore the previous position of player 2
-		if (!players[1].insideWindow(50))
-			players[1].setPosition(prevPos.x, prevPos.y);
-
-		// on collision with sandbags or barrels, restore the previous position of player 2
-		if (players[1].checkCollision(barrels, sandbags, numBarrels, numSandbags))
-			players[1].setPosition(prevPos.x, prevPos.y);
+		// a restart of the game, as between two matches of a MatchRunner
+		unsigned int restarts = 0;
+		measure("Game::reset", 1, [&]() {
+			game.reset(++restarts);
+			return (long long)restarts;
+		});
 
-		// move every bullet in the list
-		bullets->update();
+		// sprites going into the draw list of a frame; the texture is never uploaded, only its
+		// address is recorded
+		sf::Texture texture;
+		DrawList drawList;
+		for (int n = 64; n <= 4096; n *= 8) {
+			vector<Object> sprites(n);
+			for (int i = 0; i < n; i++) {
+				sprites[i].init(&drawList, string(), Coord(random(0, w), random(0, h)));
+				sprites[i].setTexture(texture);
+			}
+			measure("Object::paint/" + to_string(n), n, [&]() {
+				drawList.clear();
+				for (int i = 0; i < n; i++)
+					sprites[i].paint();
+				return (long long)n;
+			});
+		}
+	}
 
-		// collisions of bullets with other objects
-		bullets->checkCollision(players, barrels, sandbags, numPlayers, numBarrels, numSandbags);
-
-		// draw grass background
-		window->clear(color.Black);
-		drawBackground();
-
-		// draw game objects
-		for (int i = 0; i < numBarrels; i++)
-			if (barrels[i].getVisible())
-				barrels[i].paint();
-		for (int i = 0; i < numSandbags; i++)
-			sandbags[i].paint();
-		for (int i = 0; i < numPlayers; i++)
-			players[i].paint();
-		bullets->paint();
-
-		if (!gameOver()) {
-			// display the scoreboard at the bottom of the screen at the center
-			ostringstream stream;
-			stream << "Player  1: " << players[0].getScore() << endl;
-			stream << "Player 2: " << players[1].getScore();
-			text.setString(stream.str());
-			text.setPosition(width * 0.4f, height * 0.9f);
-			window->draw(text);
+	// writes the results in Google Benchmark's JSON format, returns false on failure
+	bool write(string path) {
+		ofstream file(path.c_str());
+		file << "{\n  \"context\": {\n    \"executable\": \"game\",\n    \"num_cpus\": " << thread::hardware_concurrency()
+#ifdef NDEBUG
+			<< ",\n    \"library_build_type\": \"release\"\n  },\n"
+#else
+			<< ",\n    \"library_build_type\": \"debug\"\n  },\n"
+#endif
+			<< "  \"benchmarks\": [";
+		for (size_t i = 0; i < results.size(); i++) {
+			const Result& r = results[i];
+			file << (i > 0 ? "," : "") << "\n    {\n      \"name\": \"" << r.name << "\",\n      \"run_name\": \"" << r.name
+				<< "\",\n      \"run_type\": \"iteration\",\n      \"repetitions\": 1,\n      \"repetition_index\": 0,\n      \"threads\": 1,"
+				<< "\n      \"iterations\": " << r.iterations << ",\n      \"real_time\": " << r.realNs << ",\n      \"cpu_time\": " << r.cpuNs
+				<< ",\n      \"time_unit\": \"ns\",\n      \"items_per_second\": " << r.itemsPerSecond << "\n    }";
 		}
-		else {
-			// display the winning message
-			ostringstream stream;
-			stream << "Player ";
-			stream << (players[0].getScore() > players[1].getScore() ? 1 : 2);
-			stream << " wins, start over? (Y/N)";
-			text.setString(stream.str());
-			text.setPosition(width * 0.2f, height * 0.9f);
-			window->draw(text);
+		file << "\n  ]\n}\n";
+		return (bool)file;
+	}
+
+private:
+	// times a case which handles the given number of items per iteration
+	template <class F>
+	void measure(string name, long long items, F body) {
+		long long iterations = 1;
+		while (true) {
+			clock_t cpuStart = clock();
+			auto start = chrono::steady_clock::now();
+			for (long long i = 0; i < iterations; i++)
+				sink += body();
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			double cpuSeconds = (double)(clock() - cpuStart) / CLOCKS_PER_SEC;
+
+			if (seconds >= minSeconds || iterations >= 1000000000) {
+				Result r;
+				r.name = name;
+				r.iterations = iterations;
+				r.realNs = seconds * 1e9 / iterations;
+				r.cpuNs = cpuSeconds * 1e9 / iterations;
+				r.itemsPerSecond = items * iterations / seconds;
+				results.push_back(r);
+				cout << name << ": " << r.realNs << " ns, " << iterations << " iterations, " << r.itemsPerSecond << " items/s" << endl;
+				return;
+			}
+
+			// aim a bit past the minimum time, growing at most tenfold like Google Benchmark
+			long long next = seconds > 0 ? (long long)(iterations * 1.4 * minSeconds / seconds) + 1 : iterations * 10;
+			iterations = next < iterations * 10 ? next : iterations * 10;
 		}
 	}
 };
 
-int main()
+int main(int argc, char* argv[])
 {
-	Game game_obj(10, 1024, 768, 5, 5, 2);
+	// "--bots N" lets bots play: 1 takes over player 2, 2 both players, more adds extra players
+	// "--matches N" plays N headless bot matches instead, see MatchRunner
+	// "--level FILE" loads a text, binary or world level, "--compile-level FILE" writes it in binary form
+	// "--compile-world FILE" writes it as a world file whose chunks are streamed, for very large maps
+	// "--bench-particles N" times the particle system with N live particles and exits
+	// "--bench-micro FILE" times the hot primitives and writes the results as JSON to FILE
+	// "--bench-jobs N" times a match of N bots and the particle system on 1 up to 32 threads and exits
+	// "--threaded" simulates on its own thread while the main thread only draws
+	// "--input-thread" reads the keyboard on a thread of its own
+	// "--twin-stick" lets player 1 aim with the mouse while walking with the arrow keys
+	// "--stress N" measures the tick jitter of N bot ticks under a slow window, without and with --threaded
+	// "--golden FILE" plays 300 bot ticks without a window and renders the last frame in software,
+	//     without the scoreboard, then compares it with the image FILE pixel by pixel, or writes
+	//     the image if FILE does not exist yet
+	// "--record FILE" writes the frames of the game into a capture file
+	// "--replay FILE" draws the frames of a capture in a window and times them, "--software" without one
+	// "--trace FILE" records a Chrome trace of the game, written on F9 and when the game exits
+	// "--hitch MS" writes the game state and a trace of the last frames whenever a frame takes longer
+	// "--split" gives both players their own half of the screen on maps larger than the window
+	// "--watch" reloads changed textures, the font and the level file while the game runs
+	// "--pack FILE" writes the decoded assets of the level into a bundle, LZ4 compressed with "--lz4"
+	// "--bundle FILE" loads the assets from a bundle, assets.bundle next to the game is used when present
+	int numBots = 0;
+	bool split = false;
+	bool threaded = false;
+	bool inputThread = false;
+	bool twinStick = false;
+	bool watch = false;
+	bool lz4 = false;
+	int stressTicks = 0;
+	int numMatches = 0;
+	int numThreads = thread::hardware_concurrency();
+	unsigned int seed = 1;
+	string csvPath = "matches.csv";
+	string levelPath;
+	string compiledPath;
+	string worldPath;
+	string packPath;
+	string bundlePath;
+	int benchParticles = 0;
+	int benchJobs = 0;
+	string benchPath;
+	string goldenPath;
+	string recordPath;
+	string replayPath;
+	bool software = false;
+	string tracePath;
+	double hitchMs = 0;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--split")
+			split = true;
+		if (arg == "--threaded")
+			threaded = true;
+		if (arg == "--input-thread")
+			inputThread = true;
+		if (arg == "--software")
+			software = true;
+		if (arg == "--twin-stick")
+			twinStick = true;
+		if (arg == "--watch")
+			watch = true;
+		if (arg == "--lz4")
+			lz4 = true;
+		if (i + 1 == argc)
+			break;
+		if (arg == "--bots")
+			numBots = atoi(argv[i + 1]);
+		if (arg == "--matches")
+			numMatches = atoi(argv[i + 1]);
+		if (arg == "--threads")
+			numThreads = atoi(argv[i + 1]);
+		if (arg == "--seed")
+			seed = (unsigned int)atoi(argv[i + 1]);
+		if (arg == "--csv")
+			csvPath = argv[i + 1];
+		if (arg == "--level")
+			levelPath = argv[i + 1];
+		if (arg == "--compile-level")
+			compiledPath = argv[i + 1];
+		if (arg == "--compile-world")
+			worldPath = argv[i + 1];
+		if (arg == "--pack")
+			packPath = argv[i + 1];
+		if (arg == "--bundle")
+			bundlePath = argv[i + 1];
+		if (arg == "--bench-particles")
+			benchParticles = atoi(argv[i + 1]);
+		if (arg == "--bench-jobs")
+			benchJobs = atoi(argv[i + 1]);
+		if (arg == "--bench-micro")
+			benchPath = argv[i + 1];
+		if (arg == "--golden")
+			goldenPath = argv[i + 1];
+		if (arg == "--record")
+			recordPath = argv[i + 1];
+		if (arg == "--replay")
+			replayPath = argv[i + 1];
+		if (arg == "--stress")
+			stressTicks = atoi(argv[i + 1]);
+		if (arg == "--trace")
+			tracePath = argv[i + 1];
+		if (arg == "--hitch")
+			hitchMs = atof(argv[i + 1]);
+	}
 
-	// game loop
-	while (game_obj.isOpen()) {
-		// process game events
-		game_obj.processEvents();
+	// hitches need the trace of the frames before them, which is recorded even without a file
+	Tracer::nameThread("main");
+	if (!tracePath.empty() || hitchMs > 0)
+		Tracer::instance().start(tracePath);
+
+	if (benchParticles > 0) {
+		ParticleSystem::benchmark(benchParticles, 600, nullptr);
+		return 0;
+	}
+
+	// level.txt next to the game is used when present, otherwise the built-in level
+	Level level;
+	string error;
+	if (levelPath.empty() && ifstream("level.txt"))
+		levelPath = "level.txt";
+	if (levelPath.empty())
+		level.loadDefault();
+	else if (!level.load(levelPath, error)) {
+		cerr << error << endl;
+		return 1;
+	}
+
+	if ((!compiledPath.empty() || !worldPath.empty()) && level.isChunked()) {
+		cerr << "a world file can not be compiled again" << endl;
+		return 1;
+	}
+	if (!compiledPath.empty())
+		return level.save(compiledPath) ? 0 : 1;
+	if (!worldPath.empty())
+		return level.saveWorld(worldPath, 256) ? 0 : 1;
+	if (!packPath.empty()) {
+		AssetPacker packer;
+		packer.addGame(level);
+		return packer.write(packPath, lz4) ? 0 : 1;
+	}
+
+	if (bundlePath.empty() && ifstream("assets.bundle"))
+		bundlePath = "assets.bundle";
+	if (!bundlePath.empty() && !AssetBundle::instance().open(bundlePath, error)) {
+		cerr << error << endl;
+		return 1;
+	}
+
+	// every mode but the plain game needs bots, and the plain game only with --bots
+	if ((numBots > 0 || numMatches > 0 || benchJobs > 0 || stressTicks > 0 || !goldenPath.empty())
+		&& !Game::allowsBots(level, error)) {
+		cerr << error << endl;
+		return 1;
+	}
+
+	if (benchJobs > 0) {
+		Game::benchmark(level, benchJobs, 1000);
+		return 0;
+	}
+
+	if (!benchPath.empty()) {
+		MicroBenchmarks benchmarks(0.2);
+		benchmarks.run(level);
+		return benchmarks.write(benchPath) ? 0 : 1;
+	}
+
+	// the matches themselves run in parallel, so every match keeps to one thread
+	if (numMatches > 0) {
+		MatchRunner runner(&level, numMatches, numThreads, numBots > 2 ? numBots : 2, seed);
+		return runner.run(csvPath) ? 0 : 1;
+	}
+
+	if (stressTicks > 0) {
+		// bots play at 60 ticks per second while every frame of the window takes 25 ms
+		for (int t = 0; t < 2; t++) {
+			Game stress(10, level, 2, seed);
+			stress.setBot(0);
+			stress.setBot(1);
+			stress.setHitchThreshold(hitchMs);
+			TickStats stats = stress.run(t == 1, 1 / 60.0, stressTicks, 0.025);
+			stats.print(t == 1 ? "threaded" : "single thread", 1000 / 60.0);
+		}
+		return 0;
+	}
+
+	JobSystem jobs(numThreads - 1);
+	if (!replayPath.empty())
+		return DrawPlayer::benchmark(replayPath, software, &jobs) ? 0 : 1;
+
+	if (!goldenPath.empty()) {
+		// no window and no graphics card are involved, the frame is rendered in software
+		Game golden(10, level, numBots > 2 ? numBots : 2, seed, Game::Offscreen);
+		golden.setJobs(&jobs);
+		golden.setSplitScreen(split);
+		for (int i = 0; i < (numBots > 2 ? numBots : 2); i++)
+			golden.setBot(i);
+		for (int t = 0; t < 300; t++) {
+			golden.step();
+			golden.draw();
+		}
+		long long differ = golden.checkFrame(goldenPath);
+		if (differ != 0)
+			cerr << (differ < 0 ? "could not write " + goldenPath : to_string(differ) + " pixels differ from " + goldenPath) << endl;
+		return differ == 0 ? 0 : 1;
+	}
 
-		// draw all objects and update screen
-		game_obj.update();
+	Game game_obj(10, level, numBots > 2 ? numBots : 2);
+	game_obj.setJobs(&jobs);
+	game_obj.setSplitScreen(split);
+	game_obj.setInputThread(inputThread);
+	game_obj.setTwinStick(twinStick);
+	game_obj.setHotReload(watch, levelPath);
+	for (int i = 0; i < numBots; i++)
+		game_obj.setBot(numBots == 1 ? 1 : i);
 
-		// sleep code limits the speed
-		sf::sleep(sf::seconds(0.1f));
+	game_obj.setHitchThreshold(hitchMs);
+	if (!recordPath.empty() && !game_obj.startRecording(recordPath)) {
+		cerr << "could not write " << recordPath << endl;
+		return 1;
 	}
 
+	// game loop
+	TickStats stats = game_obj.run(threaded, 0.1);
+	if (hitchMs > 0)
+		stats.print("frames", 100);
+
 	return 0;
 }
\ No newline at end of file